@@ -0,0 +1,41 @@
+/**
+* \file
+* \copyright BSD 3-Clause
+*
+* Setup and reporting shared by the benchmarks, which render their bars to /dev/null and print one line of results
+* per run to stdout.
+*/
+
+#ifndef PROGRESSBAR_BENCH_H
+#define PROGRESSBAR_BENCH_H
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+/**
+* Redirect stderr, which the bars render to, to /dev/null, so that the benchmark measures the library rather than the
+* terminal. Call before the first bar is created, as bars check whether stderr is a terminal only once. Returns 0 on
+* success, or -1 after printing the error.
+*/
+static inline int bench_silence_stderr(void)
+{
+  int null = open("/dev/null", O_WRONLY);
+  if (null < 0 || dup2(null, STDERR_FILENO) < 0) {
+    perror("/dev/null");
+    return -1;
+  }
+  close(null);
+  return 0;
+}
+
+/**
+* Name a run at a given thread count. Such runs report the wall time per operation across all threads, so that
+* perfect scaling halves with each doubling.
+*/
+static inline void bench_thread_label(char *label, size_t capacity, const char *name, unsigned int threads)
+{
+  snprintf(label, capacity, "%s x%u threads", name, threads);
+}
+
+#endif
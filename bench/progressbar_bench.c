@@ -0,0 +1,242 @@
+/**
+* \file
+* \copyright BSD 3-Clause
+*
+* Micro-benchmarks for the progressbar library: the cost of an increment, of a frame, the number of syscalls per
+* frame, and the scaling of concurrent increments across threads. The bars render to /dev/null, so the benchmark
+* runs headless; results are printed to stdout.
+*
+* Usage: progressbar_bench [max-threads]
+*/
+
+#define PROGRESSBAR_IMPLEMENTATION
+#include "../progressbar.h"
+#include "bench.h"
+
+#include <stdarg.h>
+#include <sys/syscall.h>
+
+/// Number of write(2) and ioctl(2) calls made by the process, counted by the shims below
+static unsigned long bench_writes;
+static unsigned long bench_write_bytes;
+static unsigned long bench_ioctls;
+
+/*
+ * The progressbar implementation is compiled into this file, so these definitions take precedence over the C
+ * library's and let us count the syscalls a frame costs.
+ */
+ssize_t write(int fd, const void *buffer, size_t length)
+{
+  __atomic_add_fetch(&bench_writes, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&bench_write_bytes, length, __ATOMIC_RELAXED);
+  return syscall(SYS_write, fd, buffer, length);
+}
+
+int ioctl(int fd, unsigned long request, ...)
+{
+  va_list args;
+  va_start(args, request);
+  void *arg = va_arg(args, void *);
+  va_end(args);
+
+  __atomic_add_fetch(&bench_ioctls, 1, __ATOMIC_RELAXED);
+  return syscall(SYS_ioctl, fd, request, arg);
+}
+
+static void bench_reset_counters(void)
+{
+  bench_writes = 0;
+  bench_write_bytes = 0;
+  bench_ioctls = 0;
+}
+
+static void bench_report(const char *name, double seconds, unsigned long operations)
+{
+  printf("%-40s %10.2f ns/op  %8lu writes  %10lu bytes  %6lu ioctls\n",
+         name, seconds * 1e9 / operations, bench_writes, bench_write_bytes, bench_ioctls);
+}
+
+/**
+* Create a bar that renders in place like on a terminal, although stderr is redirected to /dev/null.
+*/
+static progressbar *bench_new(unsigned long max)
+{
+  progressbar *bar = progressbar_new("bench", max);
+  progressbar_set_headless(bar, 0, DEFAULT_REDRAW_INTERVAL, 0);
+  return bar;
+}
+
+static void bench_inc(unsigned long iterations)
+{
+  progressbar *bar = bench_new(iterations);
+  bench_reset_counters();
+  double start = progressbar_now();
+  unsigned long i;
+  for (i = 0; i < iterations; ++i) {
+    progressbar_inc(bar);
+  }
+  progressbar_finish(bar);
+  bench_report("progressbar_inc", progressbar_now() - start, iterations);
+}
+
+static void bench_inc_disabled(unsigned long iterations)
+{
+  progressbar_set_enabled(0);
+  progressbar *bar = bench_new(iterations);
+  progressbar_set_enabled(1);
+  bench_reset_counters();
+  double start = progressbar_now();
+  unsigned long i;
+  for (i = 0; i < iterations; ++i) {
+    progressbar_inc(bar);
+  }
+  progressbar_finish(bar);
+  bench_report("progressbar_inc (turned off)", progressbar_now() - start, iterations);
+}
+
+static void bench_add(unsigned long iterations)
+{
+  progressbar *bar = bench_new(iterations * 4096);
+  bench_reset_counters();
+  double start = progressbar_now();
+  unsigned long i;
+  for (i = 0; i < iterations; ++i) {
+    progressbar_add(bar, 4096);
+  }
+  progressbar_finish(bar);
+  bench_report("progressbar_add(4096)", progressbar_now() - start, iterations);
+}
+
+static void bench_draw(unsigned long iterations)
+{
+  progressbar *bar = bench_new(iterations);
+  progressbar_show_rate(bar, "B", PROGRESSBAR_RATE_IEC, 1.0);
+
+  bench_reset_counters();
+  double start = progressbar_now();
+  unsigned long i;
+  for (i = 0; i < iterations; ++i) {
+    bar->value = i;
+    progressbar_draw(bar);
+  }
+  double elapsed = progressbar_now() - start;
+  bench_report("progressbar_draw", elapsed, iterations);
+  printf("%-40s %10.2f writes/frame %7.2f ioctls/frame\n", "",
+         (double) bench_writes / iterations, (double) bench_ioctls / iterations);
+
+  progressbar_finish(bar);
+}
+
+static void bench_draw_incremental(unsigned long iterations)
+{
+  progressbar *bar = bench_new(iterations);
+  progressbar_show_rate(bar, "B", PROGRESSBAR_RATE_IEC, 1.0);
+  progressbar_set_incremental(bar, 1);
+
+  bench_reset_counters();
+  double start = progressbar_now();
+  unsigned long i;
+  for (i = 0; i < iterations; ++i) {
+    bar->value = i;
+    progressbar_draw(bar);
+  }
+  bench_report("progressbar_draw (incremental)", progressbar_now() - start, iterations);
+  // Most of these frames don't change a cell and write nothing at all; compare the frames that do write something.
+  printf("%-40s %10.2f bytes per frame written\n", "", (double) bench_write_bytes / bench_writes);
+
+  progressbar_finish(bar);
+}
+
+static void bench_draw_ring(unsigned long iterations)
+{
+  // Compose into memory, so that the frame cost is measured without the syscall.
+  static char ring[4096];
+  progressbar *bar = bench_new(iterations);
+  progressbar_show_rate(bar, "B", PROGRESSBAR_RATE_IEC, 1.0);
+  progressbar_set_sink_ring(bar, ring, sizeof(ring));
+
+  bench_reset_counters();
+  double start = progressbar_now();
+  unsigned long i;
+  for (i = 0; i < iterations; ++i) {
+    bar->value = i;
+    progressbar_draw(bar);
+  }
+  bench_report("progressbar_draw (ring sink)", progressbar_now() - start, iterations);
+
+  progressbar_finish(bar);
+}
+
+typedef struct {
+  progressbar *bar;
+  unsigned long iterations;
+  int sharded;
+} bench_worker_args;
+
+static void *bench_worker(void *arg)
+{
+  bench_worker_args *args = (bench_worker_args *) arg;
+  unsigned long i;
+
+  if (args->sharded) {
+    progressbar_shard *shard = progressbar_register_thread(args->bar);
+    for (i = 0; i < args->iterations; ++i) {
+      progressbar_shard_inc(shard);
+    }
+    progressbar_unregister_thread(shard);
+  } else {
+    for (i = 0; i < args->iterations; ++i) {
+      progressbar_inc_concurrent(args->bar);
+    }
+  }
+  return NULL;
+}
+
+static void bench_threads(unsigned int threads, unsigned long iterations, int sharded)
+{
+  pthread_t workers[threads];
+  bench_worker_args args = {NULL, iterations, sharded};
+  unsigned int i;
+
+  args.bar = bench_new(iterations * threads);
+  if (sharded) {
+    progressbar_enable_shards(args.bar, threads);
+  }
+
+  bench_reset_counters();
+  double start = progressbar_now();
+  for (i = 0; i < threads; ++i) {
+    pthread_create(&workers[i], NULL, bench_worker, &args);
+  }
+  for (i = 0; i < threads; ++i) {
+    pthread_join(workers[i], NULL);
+  }
+  double elapsed = progressbar_now() - start;
+  progressbar_finish(args.bar);
+
+  char name[64];
+  bench_thread_label(name, sizeof(name), sharded ? "progressbar_shard_inc" : "progressbar_inc_concurrent", threads);
+  bench_report(name, elapsed, iterations * threads);
+}
+
+int main(int argc, char **argv)
+{
+  unsigned int max_threads = (argc > 1) ? (unsigned int) atoi(argv[1]) : (unsigned int) sysconf(_SC_NPROCESSORS_ONLN);
+  unsigned int threads;
+
+  if (bench_silence_stderr() != 0) {
+    return 1;
+  }
+
+  bench_inc(100000000UL);
+  bench_inc_disabled(100000000UL);
+  bench_add(10000000UL);
+  bench_draw(100000UL);
+  bench_draw_incremental(100000UL);
+  bench_draw_ring(100000UL);
+  for (threads = 1; threads <= max_threads; threads *= 2) {
+    bench_threads(threads, 20000000UL / threads, 0);
+    bench_threads(threads, 20000000UL / threads, 1);
+  }
+  return 0;
+}
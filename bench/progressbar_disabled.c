@@ -0,0 +1,57 @@
+/**
+* \file
+* \copyright BSD 3-Clause
+*
+* Codegen check for PROGRESSBAR_DISABLE: the kernel below is compiled once with its progress calls under
+* PROGRESSBAR_DISABLE and once without any progress calls (BENCH_WITHOUT_PROGRESS), and `make bench-disabled`
+* compares the disassembly of both, which must be identical. The program itself times the kernel.
+*/
+
+#define PROGRESSBAR_DISABLE
+#include "../progressbar.h"
+
+/// Number of elements the kernel sums up
+enum { BENCH_ELEMENTS = 1 << 20 };
+/// Number of times the kernel is run
+enum { BENCH_ROUNDS = 200 };
+
+/**
+* Sum up the squares of `count` elements, reporting progress per element.
+*/
+double bench_kernel(const double *data, unsigned long count)
+{
+#ifndef BENCH_WITHOUT_PROGRESS
+  progressbar *bar = progressbar_new("kernel", count);
+#endif
+  double sum = 0;
+  unsigned long i;
+  for (i = 0; i < count; ++i) {
+    sum += data[i] * data[i];
+#ifndef BENCH_WITHOUT_PROGRESS
+    progressbar_inc(bar);
+#endif
+  }
+#ifndef BENCH_WITHOUT_PROGRESS
+  progressbar_finish(bar);
+#endif
+  return sum;
+}
+
+int main(void)
+{
+  static double data[BENCH_ELEMENTS];
+  unsigned long i;
+  for (i = 0; i < BENCH_ELEMENTS; ++i) {
+    data[i] = (double) i / BENCH_ELEMENTS;
+  }
+
+  double sum = 0;
+  double start = progressbar_now();
+  for (i = 0; i < BENCH_ROUNDS; ++i) {
+    sum += bench_kernel(data, BENCH_ELEMENTS);
+  }
+  double elapsed = progressbar_now() - start;
+  printf("%-40s %10.2f ns/element  (checksum %g)\n", "bench_kernel", elapsed * 1e9 / BENCH_ELEMENTS / BENCH_ROUNDS,
+         sum);
+  return 0;
+}
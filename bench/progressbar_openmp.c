@@ -0,0 +1,83 @@
+/**
+* \file
+* \copyright BSD 3-Clause
+*
+* Scaling of progress reporting in OpenMP loops across thread counts: a plain `omp parallel for` loop without
+* progress, the same loop calling progressbar_inc_concurrent on every iteration, and omp_for_bar. The bars render to
+* /dev/null; results are printed to stdout.
+*
+* Usage: progressbar_openmp [max-threads]
+*/
+
+#define PROGRESSBAR_IMPLEMENTATION
+#include "../progressbar.h"
+#include "bench.h"
+
+#include <math.h>
+
+/// Number of iterations of each loop
+enum { BENCH_ITERATIONS = 1 << 26 };
+
+static double bench_data[BENCH_ITERATIONS];
+
+static void bench_report(const char *name, int threads, double seconds)
+{
+  char label[64];
+  bench_thread_label(label, sizeof(label), name, (unsigned int) threads);
+  printf("%-40s %10.2f ns/iteration\n", label, seconds * 1e9 / BENCH_ITERATIONS);
+}
+
+static void bench_plain(int threads)
+{
+  double start = progressbar_now();
+  #pragma omp parallel for
+  for (int i = 0; i < BENCH_ITERATIONS; i++) {
+    bench_data[i] = sqrt(bench_data[i] + i);
+  }
+  bench_report("omp parallel for", threads, progressbar_now() - start);
+}
+
+static void bench_inc_concurrent(int threads)
+{
+  double start = progressbar_now();
+  progressbar *bar = progressbar_new("bench", BENCH_ITERATIONS);
+  #pragma omp parallel for
+  for (int i = 0; i < BENCH_ITERATIONS; i++) {
+    bench_data[i] = sqrt(bench_data[i] + i);
+    progressbar_inc_concurrent(bar);
+  }
+  progressbar_finish(bar);
+  bench_report("progressbar_inc_concurrent", threads, progressbar_now() - start);
+}
+
+static void bench_omp_for_bar(int threads)
+{
+  double start = progressbar_now();
+  omp_for_bar(0, BENCH_ITERATIONS, {
+    bench_data[i] = sqrt(bench_data[i] + i);
+  });
+  bench_report("omp_for_bar", threads, progressbar_now() - start);
+}
+
+int main(int argc, char **argv)
+{
+  int max_threads = (argc > 1) ? atoi(argv[1]) : omp_get_num_procs();
+  int threads;
+
+  if (bench_silence_stderr() != 0) {
+    return 1;
+  }
+
+  // Fault the data in, so that the first loop doesn't pay for it.
+  for (int i = 0; i < BENCH_ITERATIONS; i++) {
+    bench_data[i] = i;
+  }
+
+  for (threads = 1; threads <= max_threads; threads *= 2) {
+    omp_set_num_threads(threads);
+    bench_plain(threads);
+    bench_inc_concurrent(threads);
+    bench_omp_for_bar(threads);
+  }
+  return 0;
+}
@@ -0,0 +1,69 @@
+/**
+* \file
+* \copyright BSD 3-Clause
+*
+* Overhead of the progress-aware parallel algorithms: std::for_each and std::transform under std::execution::par,
+* with and without a progressbar. The bars render to /dev/null; results are printed to stdout.
+*
+* Usage: progressbar_parallel [elements]
+*/
+
+#include <execution>
+
+#define PROGRESSBAR_IMPLEMENTATION
+#include "../progressbar.h"
+#include "bench.h"
+
+#include <cmath>
+#include <vector>
+
+/// Number of times each variant is run; the fastest run is reported
+enum { BENCH_ROUNDS = 5 };
+
+template <class Function>
+static double bench_best(Function run)
+{
+  double best = 0;
+  for (int round = 0; round < BENCH_ROUNDS; ++round) {
+    double start = progressbar_now();
+    run();
+    double elapsed = progressbar_now() - start;
+    if (round == 0 || elapsed < best) {
+      best = elapsed;
+    }
+  }
+  return best;
+}
+
+static void bench_report(const char *name, double plain, double tracked, std::size_t elements)
+{
+  printf("%-40s %10.2f ns/element  %10.2f ns/element with progress  %+6.2f%%\n", name, plain * 1e9 / elements,
+         tracked * 1e9 / elements, (tracked - plain) / plain * 100);
+}
+
+int main(int argc, char **argv)
+{
+  std::size_t elements = (argc > 1) ? (std::size_t) atol(argv[1]) : 100000000UL;
+
+  if (bench_silence_stderr() != 0) {
+    return 1;
+  }
+
+  std::vector<double> input(elements, 2.0);
+  std::vector<double> output(elements);
+  auto work = [](double &x) { x = std::sqrt(x * x + 1.0); };
+  auto op = [](double x) { return std::sqrt(x * x + 1.0); };
+
+  double plain = bench_best([&] { std::for_each(std::execution::par, input.begin(), input.end(), work); });
+  double tracked = bench_best([&] {
+    progress::for_each(std::execution::par, input.begin(), input.end(), work, "for_each");
+  });
+  bench_report("for_each(par)", plain, tracked, elements);
+
+  plain = bench_best([&] { std::transform(std::execution::par, input.begin(), input.end(), output.begin(), op); });
+  tracked = bench_best([&] {
+    progress::transform(std::execution::par, input.begin(), input.end(), output.begin(), op, "transform");
+  });
+  bench_report("transform(par)", plain, tracked, elements);
+  return 0;
+}
@@ -0,0 +1,9 @@
+/**
+* \file
+* \copyright BSD 3-Clause
+*
+* Compiles the implementation of the progressbar single-header library, for use as a static or shared library.
+*/
+
+#define PROGRESSBAR_IMPLEMENTATION
+#include "progressbar.h"
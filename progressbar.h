@@ -8,22 +8,40 @@
 *
 * progressbar -- a C class (by convention) for displaying progress
 * on the command line (to stderr).
+*
+* This is a single-header library: include it wherever progressbars are used, and in exactly one C or C++ file
+* define PROGRESSBAR_IMPLEMENTATION before including it to compile the implementation (or link against the
+* library built by the Makefile, which does just that in progressbar.c).
 */
 
 #ifndef PROGRESSBAR_H
 #define PROGRESSBAR_H
 
+#include <pthread.h>
+#include <stdint.h>
 #include <time.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 #define printf_bar(...) { printf("\33[2K\r"); printf(__VA_ARGS__); }
+#ifdef PROGRESSBAR_DISABLE
+#define for_bar(start, end, ...)                            \
+    for(int i = start; i < end; i++) {                      \
+        __VA_ARGS__                                         \
+    }                                                       \
+
+#else
+// The block scopes `progress`, so that several for_bar loops can follow each other.
 #define for_bar(start, end, ...)                            \
+    {                                                       \
     progressbar *progress = progressbar_new("Loading",end); \
     for(int i = start; i < end; i++) {                      \
         {                                                   \
@@ -32,6 +50,200 @@ extern "C" {
         progressbar_inc(progress);                          \
     }                                                       \
     progressbar_finish(progress);                           \
+    }                                                       \
+
+#endif
+
+#if defined(_OPENMP) && !defined(PROGRESSBAR_DISABLE)
+/// Like for_bar, but the iterations run in parallel as an OpenMP loop, and the body can't `break` out of it. The
+/// range is split into PROGRESSBAR_OMP_CHUNKS chunks scheduled dynamically; a thread only adds to the bar once per
+/// chunk, and only the master thread renders (see progressbar_omp_flush).
+#define omp_for_bar(start, end, ...)                                                          \
+    {                                                                                         \
+    int progress_start = (start), progress_end = (end);                                      \
+    int progress_chunk = (progress_end - progress_start) / PROGRESSBAR_OMP_CHUNKS + 1;       \
+    progressbar *progress = progressbar_new("Loading", progress_end - progress_start);       \
+    _Pragma("omp parallel for schedule(dynamic)")                                            \
+    for (int progress_first = progress_start; progress_first < progress_end;                 \
+         progress_first += progress_chunk) {                                                  \
+        int progress_last = (progress_end - progress_first < progress_chunk)                 \
+                            ? progress_end : progress_first + progress_chunk;                 \
+        for (int i = progress_first; i < progress_last; i++) {                                \
+            __VA_ARGS__                                                                       \
+        }                                                                                     \
+        progressbar_omp_flush(progress, progress_last - progress_first);                     \
+    }                                                                                         \
+    progressbar_finish(progress);                                                             \
+    }                                                                                         \
+
+#elif defined(_OPENMP)
+#define omp_for_bar(start, end, ...)                                                          \
+    _Pragma("omp parallel for")                                                               \
+    for (int i = (start); i < (end); i++) {                                                   \
+        __VA_ARGS__                                                                           \
+    }                                                                                         \
+
+#else
+#define omp_for_bar(start, end, ...) for_bar(start, end, __VA_ARGS__)
+#endif
+
+/// The number of chunks omp_for_bar splits its range into
+enum { PROGRESSBAR_OMP_CHUNKS = 4096 };
+
+/// The widest screen that a progressbar will fill; wider terminals get a bar of this width.
+enum { PROGRESSBAR_MAX_SCREEN_WIDTH = 512 };
+/// The capacity of the buffer a frame is composed in (the screen, plus room for an oversized ETA and the `\r`).
+enum { PROGRESSBAR_LINE_CAPACITY = PROGRESSBAR_MAX_SCREEN_WIDTH + 64 };
+
+/// The default number of seconds between two status lines of a headless progressbar
+enum { PROGRESSBAR_HEADLESS_INTERVAL = 30 };
+/// The default progress, in percent, after which a headless progressbar logs a status line
+enum { PROGRESSBAR_HEADLESS_PERCENT_STEP = 10 };
+/// The default number of milliseconds between two refreshes of a group of progressbars
+enum { PROGRESSBAR_GROUP_INTERVAL_MS = 100 };
+
+/// The longest unit that can be displayed with the rate of a progressbar
+enum { PROGRESSBAR_RATE_UNIT_MAX = 8 };
+
+/// The longest label, including its terminating NUL, that an exported progressbar publishes
+enum { PROGRESSBAR_EXPORT_LABEL_CAPACITY = 64 };
+/// The longest shared memory object name, including its terminating NUL, that a progressbar can be exported to
+enum { PROGRESSBAR_EXPORT_NAME_CAPACITY = 64 };
+/// The progress, in percent, after which an exported progressbar publishes its state
+enum { PROGRESSBAR_EXPORT_PERCENT_STEP = 1 };
+/// Identifies a shared memory object as an exported progressbar ("PBAR"), and the version of its layout
+enum { PROGRESSBAR_EXPORT_MAGIC = 0x50424152, PROGRESSBAR_EXPORT_VERSION = 1 };
+/// The prefix of the shared memory objects progressbars are exported to by default, which observers scan for
+#define PROGRESSBAR_EXPORT_PREFIX "/progressbar."
+
+/// The size of a cache line; per-thread counters are padded to this size so that they never share a line.
+enum { PROGRESSBAR_CACHE_LINE = 64 };
+
+struct _progressbar_t;
+struct _progressbar_group_t;
+
+/// How the throughput shown by a progressbar is scaled (see progressbar_show_rate)
+typedef enum {
+  /// decimal prefixes: k = 1000, M = 1000^2, ...
+  PROGRESSBAR_RATE_SI,
+  /// binary prefixes: Ki = 1024, Mi = 1024^2, ...
+  PROGRESSBAR_RATE_IEC
+} progressbar_rate_scale;
+
+/// How a progressbar estimates the remaining time (see progressbar_set_eta_estimator)
+typedef enum {
+  /// assume the average rate since the start holds until the end (the default)
+  PROGRESSBAR_ETA_AVERAGE,
+  /// extrapolate an exponentially weighted moving average of the rate
+  PROGRESSBAR_ETA_EWMA,
+  /// extrapolate a least-squares line fitted to the recent progress (exponentially forgetting older samples)
+  PROGRESSBAR_ETA_REGRESSION,
+  /// extrapolate a Kalman filter tracking the value and rate
+  PROGRESSBAR_ETA_KALMAN,
+  /// call a user-provided function (see progressbar_set_eta_callback); the average is used until one is set
+  PROGRESSBAR_ETA_CALLBACK
+} progressbar_eta_estimator;
+
+/// How a progressbar is rendered (see progressbar_set_headless and progressbar_set_json)
+typedef enum {
+  /// a bar redrawn in place on a terminal (the default if stderr is a terminal)
+  PROGRESSBAR_OUTPUT_BAR,
+  /// newline-terminated, human-readable status lines for logs (the default if stderr isn't a terminal)
+  PROGRESSBAR_OUTPUT_STATUS,
+  /// newline-terminated JSON records for monitoring
+  PROGRESSBAR_OUTPUT_JSON,
+  /// no output at all; the state is published to shared memory instead (see progressbar_export)
+  PROGRESSBAR_OUTPUT_SHARED
+} progressbar_output_format;
+
+/// Where a progressbar writes its output (see progressbar_set_sink_fd and friends)
+typedef enum {
+  /// a file descriptor, written with write(2) (the default, on stderr)
+  PROGRESSBAR_SINK_FD,
+  /// a stdio stream, flushed after each frame
+  PROGRESSBAR_SINK_FILE,
+  /// a caller-provided buffer that keeps the most recent output
+  PROGRESSBAR_SINK_RING,
+  /// a user-provided function
+  PROGRESSBAR_SINK_CALLBACK,
+  /// nowhere: the bar is never rendered
+  PROGRESSBAR_SINK_NULL
+} progressbar_sink_kind;
+
+/// A user-provided sink: write the `length` characters at `data`. `state` is passed through from
+/// progressbar_set_sink_callback.
+typedef void (*progressbar_sink_callback)(void *state, const char *data, size_t length);
+
+/**
+ * The destination of a progressbar's output (do not modify directly, see progressbar_set_sink_fd and friends)
+ */
+typedef struct _progressbar_sink_t
+{
+  progressbar_sink_kind kind;
+  /// PROGRESSBAR_SINK_FD: the file descriptor
+  int fd;
+  /// PROGRESSBAR_SINK_FILE: the stream
+  FILE *file;
+  /// PROGRESSBAR_SINK_CALLBACK: the function and its state
+  progressbar_sink_callback callback;
+  void *callback_state;
+  /// PROGRESSBAR_SINK_RING: the buffer, its capacity, and the total number of characters ever written to it
+  char *ring;
+  size_t ring_capacity;
+  size_t ring_written;
+} progressbar_sink;
+
+/**
+ * The layout of the shared memory object an exported progressbar publishes its state to (see progressbar_export).
+ * The object is written by one process and read by any number of observers, guarded by a sequence lock: the writer
+ * makes `sequence` odd while it updates the record and even again once it is done, and readers retry until they
+ * copied the record between two reads of the same, even sequence (see progressbar_export_read).
+ */
+typedef struct _progressbar_export_record_t
+{
+  /// PROGRESSBAR_EXPORT_MAGIC and PROGRESSBAR_EXPORT_VERSION
+  uint32_t magic;
+  uint32_t version;
+  /// odd while the record is being updated
+  uint64_t sequence;
+  /// the process the progressbar runs in
+  int64_t pid;
+  /// current value and maximum value, rolled up over the bar's children
+  uint64_t value;
+  uint64_t max;
+  /// rate in steps per second, estimated remaining and elapsed time in seconds
+  double rate;
+  double eta;
+  double elapsed;
+  /// wall-clock time of the last update, in seconds since the epoch
+  double timestamp;
+  /// set once the progressbar is finished
+  uint32_t finished;
+  uint32_t reserved;
+  /// NUL-terminated label, truncated to fit
+  char label[PROGRESSBAR_EXPORT_LABEL_CAPACITY];
+} progressbar_export_record;
+
+/// A user-provided ETA estimator: given the current `value` out of `max` after `elapsed` seconds, return the
+/// estimated number of seconds remaining. `state` is passed through from progressbar_set_eta_callback.
+typedef double (*progressbar_eta_callback)(void *state, unsigned long value, unsigned long max, double elapsed);
+
+/**
+ * Per-thread counter of a progressbar (do not modify or create directly, see progressbar_register_thread)
+ */
+typedef struct _progressbar_shard_t
+{
+  /// number of increments made through this shard (only written by the owning thread)
+  unsigned long value;
+  /// increments left until the owning thread checks whether a redraw is due
+  unsigned int countdown;
+  /// set while the shard is registered to a thread
+  int in_use;
+  /// the progressbar this shard belongs to
+  struct _progressbar_t *bar;
+  /// pad the shard to a full cache line
+  char padding[PROGRESSBAR_CACHE_LINE - sizeof(unsigned long) - 2 * sizeof(int) - sizeof(void *)];
+} progressbar_shard;
 
 /**
  * Progressbar data structure (do not modify or create directly)
@@ -40,11 +252,187 @@ typedef struct _progressbar_t
 {
   /// maximum value
   unsigned long max;
-  /// current value
+  /// current value (updated atomically by the *_concurrent functions)
   unsigned long value;
 
-  /// time progressbar was started
-  time_t start;
+  /// time progressbar was started, in seconds on the monotonic clock (see progressbar_now)
+  double start;
+
+  /// redraw policy: the bar is only rendered again once the value leaves
+  /// [value_lo, value_hi) (i.e. enough bar cells changed) or once at least
+  /// `interval` seconds passed since the last rendering. The clock is only
+  /// sampled every `clock_stride` updates, so the common case of an update is
+  /// a counter bump and a compare; the stride follows the observed update
+  /// rate, so that the clock is sampled a few times per interval.
+  struct {
+    /// minimum number of bar cells that must change to trigger a redraw
+    unsigned int min_cells;
+    /// minimum number of seconds between two time-triggered redraws
+    double interval;
+    /// number of updates between two samples of the clock, a power of two
+    unsigned int clock_stride;
+    /// updates left until the clock is sampled again
+    unsigned int clock_countdown;
+    /// time of the last sample of the clock
+    double sampled;
+    /// values outside of [value_lo, value_hi) change the rendered bar
+    unsigned long value_lo;
+    unsigned long value_hi;
+    /// the steps rolled up from the children when the window was scheduled, which offset it for the whole tree
+    unsigned long rolled_up;
+    /// time of the last rendering
+    double last;
+    /// set while a thread renders the bar in concurrent mode
+    int drawing;
+  } redraw;
+
+  /// per-thread counters, summed up with `value` when rendering (NULL unless progressbar_enable_shards was called)
+  progressbar_shard *shards;
+  /// number of entries in `shards`
+  unsigned int shard_count;
+
+  /// background renderer thread (see progressbar_start_renderer)
+  struct {
+    pthread_t thread;
+    /// protects `stop` and lets progressbar_stop_renderer wake the thread early
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    /// set while the renderer thread is running
+    int active;
+    /// set to ask the renderer thread to exit
+    int stop;
+    /// time between two renderings, in milliseconds
+    unsigned int period_ms;
+    /// the bar's redraw interval, restored when the renderer stops
+    double interval;
+    /// the upper bound of the bar's redraw window, which the renderer applies to appended frames instead
+    unsigned long value_hi;
+  } renderer;
+
+  /// cached width of the terminal, refreshed on SIGWINCH (see progressbar_watch_resize) or every few seconds
+  struct {
+    /// number of columns
+    unsigned int width;
+    /// time the width was queried
+    double checked;
+    /// resize generation the width was queried in
+    int generation;
+  } screen;
+
+  /// live throughput display (see progressbar_show_rate)
+  struct {
+    /// unit of the counted steps, e.g. "it" or "B"; NULL if the rate isn't shown
+    const char *unit;
+    /// whether the rate is scaled with decimal or binary prefixes
+    progressbar_rate_scale scale;
+    /// time constant of the moving average, in seconds
+    double window;
+    /// exponentially weighted moving average of the rate, in steps per second
+    double ewma;
+    /// value and time at which the rate was last sampled
+    unsigned long last_value;
+    double last_time;
+  } rate;
+
+  /// estimator of the remaining time; the built-in estimators only keep a constant amount of state and are only
+  /// fed when the bar is rendered
+  struct {
+    progressbar_eta_estimator kind;
+    /// time constant of the EWMA, regression and Kalman estimators, in seconds
+    double window;
+    /// elapsed time at the last sample
+    double last_elapsed;
+    /// value at the last sample
+    unsigned long last_value;
+    /// estimated number of seconds remaining at the last sample
+    double last_remaining;
+    /// the function and its state for PROGRESSBAR_ETA_CALLBACK
+    progressbar_eta_callback callback;
+    void *callback_state;
+    union {
+      /// PROGRESSBAR_ETA_EWMA: smoothed rate in steps per second
+      struct {
+        double rate;
+      } ewma;
+      /// PROGRESSBAR_ETA_REGRESSION: exponentially decayed sums over the samples (elapsed time t, value v)
+      struct {
+        double w, t, v, tt, tv;
+      } regression;
+      /// PROGRESSBAR_ETA_KALMAN: estimated value and rate, and their covariance
+      struct {
+        double value, rate;
+        double p00, p01, p11;
+      } kalman;
+    } state;
+  } eta;
+
+  /// buffer in which each frame is composed before it is written out in one go
+  char line[PROGRESSBAR_LINE_CAPACITY];
+  /// number of characters of the last frame composed in `line`
+  size_t line_length;
+
+  /// incremental rendering: only the cells that differ from the frame on screen are written (see
+  /// progressbar_set_incremental)
+  struct {
+    int enabled;
+    /// the frame on screen, and its number of characters (0 if unknown)
+    char frame[PROGRESSBAR_LINE_CAPACITY];
+    size_t length;
+  } previous;
+
+  /// where and how the bar is rendered: in place on a terminal, or, for logs and monitoring, as a line appended
+  /// every `redraw.interval` seconds or every `percent_step` percent of progress (see progressbar_set_headless and
+  /// progressbar_set_json)
+  struct {
+    progressbar_output_format format;
+    /// where the bar is written to
+    progressbar_sink sink;
+    double percent_step;
+    /// set if the last frame composed shows the bar complete
+    int complete;
+    /// set if the bar was created while progress reporting was turned off (see progressbar_set_enabled): the bar
+    /// keeps the null sink for good, whatever sink, format or export is asked for later
+    int disabled;
+    /// set until a bar initialized by progressbar_init_deferred is first rendered
+    int deferred;
+  } output;
+
+  /// the shared memory object the bar publishes its state to, if it is exported (see progressbar_export)
+  struct {
+    /// the mapped record, or NULL if the bar isn't exported
+    progressbar_export_record *record;
+    /// the name of the shared memory object, unlinked when the bar is finished
+    char name[PROGRESSBAR_EXPORT_NAME_CAPACITY];
+  } shared;
+
+  /// the bar whose progress this bar is part of, or NULL (see progressbar_new_child)
+  struct _progressbar_t *parent;
+  /// the live bars whose progress is rolled up into this bar
+  struct _progressbar_t **children;
+  /// number of children, and number of children `children` has room for
+  unsigned int child_count;
+  unsigned int child_capacity;
+  /// position of the bar in its parent's `children`
+  unsigned int child_index;
+  /// the bar's own value (capped at its max) and max, as last added to the `descendants` sums of its ancestors
+  struct {
+    unsigned long value;
+    unsigned long max;
+  } reported;
+  /// running sums of the values and maxes reported by all descendants of the bar, finished ones included, so that
+  /// rolling up the tree takes constant time (updated atomically, as children may report from any thread)
+  struct {
+    unsigned long value;
+    unsigned long max;
+  } descendants;
+
+  /// the group this bar is displayed in, or NULL if the bar draws itself (see progressbar_group_add)
+  struct _progressbar_group_t *group;
+  /// set when the bar has to be drawn on the group's next refresh
+  int dirty;
+  /// the bar's line in the group's block, counted from the top, or -1 until the line is created (bars that aren't
+  /// drawn in place don't get a line)
+  int group_line;
 
   /// label
   const char *label;
@@ -58,6 +446,57 @@ typedef struct _progressbar_t
   } format;
 } progressbar;
 
+/**
+ * A stack of progressbars displayed as a block of lines (do not modify or create directly, see progressbar_group_new)
+ */
+typedef struct _progressbar_group_t
+{
+  /// the bars in the group, from the top line to the bottom one
+  struct _progressbar_t **bars;
+  /// number of bars in the group, and number of bars `bars` has room for
+  unsigned int count;
+  unsigned int capacity;
+  /// number of lines of the block already on screen; the cursor rests on the line below the block
+  unsigned int lines;
+  /// buffer in which a refresh of the whole block is composed before it is written out in one go
+  char *buffer;
+  /// where the block is written to (see progressbar_group_set_sink_fd and friends)
+  progressbar_sink sink;
+  /// minimum number of seconds between two refreshes triggered by the bars (see progressbar_group_set_interval)
+  double interval;
+  /// time of the last refresh
+  double last;
+  /// set while a thread refreshes the group
+  int drawing;
+} progressbar_group;
+
+/**
+ * A fixed-capacity pool of progressbars, allocated once (do not modify or create directly, see progressbar_pool_new)
+ */
+typedef struct _progressbar_pool_t
+{
+  /// storage of all bars in the pool
+  struct _progressbar_t *bars;
+  /// indices of the unused entries of `bars`, used as a stack
+  unsigned int *free_list;
+  unsigned int free_count;
+  /// number of entries in `bars`
+  unsigned int capacity;
+  /// set while a thread takes a bar from or returns a bar to the pool
+  int lock;
+} progressbar_pool;
+
+/// Return the current time in seconds on the monotonic clock. The clock has sub-microsecond resolution, is read
+/// through the vDSO without a syscall on Linux, and isn't affected by adjustments of the wall clock.
+static inline double progressbar_now(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+#ifndef PROGRESSBAR_DISABLE
+
 /// Create a new progressbar with the specified label and number of steps.
 ///
 /// @param label The label that will prefix the progressbar.
@@ -82,14 +521,195 @@ progressbar *progressbar_new(const char *label, unsigned long max);
 ///         of the progressbar via progressbar_finish when finished with the object.
 progressbar *progressbar_new_with_format(const char *label, unsigned long max, const char *format);
 
+/// Create a new progressbar like progressbar_new_with_format, but without rendering it, so that its sink, output
+/// format and redraw policy can be set up before the first frame is written. Render it via progressbar_draw.
+///
+/// @return The progressbar, or NULL if there isn't enough memory. Dispose of it via progressbar_finish.
+progressbar *progressbar_create(const char *label, unsigned long max, const char *format);
+
+/// Create a new progressbar that tracks part of the work of `parent`. The child's value and max are rolled up into
+/// the parent whenever the child is rendered, so each child weighs in proportionally to its max; the parent's own
+/// value and max count alongside. Children can have children of their own. A child isn't displayed by itself
+/// (unless it is added to a progressbar_group): whenever it would be rendered, its parent is rendered instead, as
+/// often as the parent's redraw policy allows. Calling progressbar_finish on a child folds its final progress into
+/// its ancestors and frees it (along with its own children), so finished children don't accumulate; the parent
+/// frees the children left in progressbar_finish. Create and finish the children of a bar from one thread.
+///
+/// @return The child, or NULL if there isn't enough memory.
+progressbar *progressbar_new_child(progressbar *parent, const char *label, unsigned long max);
+
+/// Initialize a progressbar in caller-provided storage (e.g. on the stack or in an arena) instead of allocating it,
+/// with the specified label and number of steps. Dispose of it via progressbar_destroy rather than
+/// progressbar_finish.
+void progressbar_init(progressbar *bar, const char *label, unsigned long max);
+
+/// Initialize a progressbar in caller-provided storage with the specified label, number of steps, and format string
+/// (see progressbar_new_with_format). Dispose of it via progressbar_destroy rather than progressbar_finish.
+void progressbar_init_with_format(progressbar *bar, const char *label, unsigned long max, const char *format);
+
+/// Initialize a progressbar in caller-provided storage like progressbar_init_with_format, but without rendering it:
+/// the bar only shows up once it has been running for its redraw interval, and if it is destroyed before that, it is
+/// never shown at all. Short-lived bars, e.g. one per request in a server, thus cost no system calls.
+void progressbar_init_deferred(progressbar *bar, const char *label, unsigned long max, const char *format);
+
+/// Finalize a progressbar initialized by progressbar_init, like progressbar_finish but without freeing the storage
+/// of the bar itself.
+void progressbar_destroy(progressbar *bar);
+
 /// Free an existing progress bar. Don't call this directly; call *progressbar_finish* instead.
 void progressbar_free(progressbar *bar);
 
-/// Increment the given progressbar. Don't increment past the initialized # of steps, though.
-void progressbar_inc(progressbar *bar);
+/// Render the given progressbar right away, regardless of its redraw policy.
+void progressbar_draw(progressbar *bar);
+
+/// Render the given progressbar if no other thread is currently rendering it and a redraw is `due` or turns out to
+/// be due. Used by the increment functions below; there is rarely a reason to call it directly.
+void progressbar_try_draw(progressbar *bar, int due);
+
+/// Sample the clock and tell whether the redraw interval of the given progressbar elapsed, adapting the number of
+/// updates until the next sample to the update rate. Used by the increment functions below once every clock stride.
+int progressbar_interval_elapsed(progressbar *bar);
+
+/// Allocate `count` per-thread counters for the given progressbar, so that up to `count` threads can increment it
+/// via progressbar_shard_inc without contending on a shared cache line. Must be called before any thread registers.
+///
+/// @return 0 on success, -1 if there isn't enough memory (in which case the bar is left unchanged).
+int progressbar_enable_shards(progressbar *bar, unsigned int count);
+
+/// Claim a per-thread counter of the given progressbar for the calling thread.
+///
+/// @return The claimed shard, or NULL if all shards are in use (callers can fall back to progressbar_inc_concurrent).
+progressbar_shard *progressbar_register_thread(progressbar *bar);
+
+/// Fold the increments of the shard into the progressbar and release it so that another thread can claim it.
+void progressbar_unregister_thread(progressbar_shard *shard);
+
+/// Render the progressbar from a background thread every `period_ms` milliseconds instead of from the threads that
+/// update it. While the renderer runs, progressbar_inc, progressbar_update and the concurrent variants only update
+/// the counters and never touch stdio or the clock. The renderer is stopped by progressbar_finish. Changing the
+/// redraw policy while the renderer runs (including via progressbar_set_headless, progressbar_set_json and
+/// progressbar_export) only changes when the renderer writes appended frames.
+///
+/// @return 0 on success, -1 if the thread couldn't be started (in which case the bar keeps rendering in place).
+int progressbar_start_renderer(progressbar *bar, unsigned int period_ms);
+
+/// Stop the background renderer of the progressbar, if any, and go back to rendering from the updating threads.
+void progressbar_stop_renderer(progressbar *bar);
+
+/// Show the throughput of the progressbar between the bar and the ETA, e.g. "12.3 MiB/s". The rate is sampled each
+/// time the bar is rendered and smoothed with an exponentially weighted moving average over roughly `window` seconds.
+/// Once the bar is complete, the average rate over the whole run is shown instead.
+///
+/// @param unit The unit of a step, at most PROGRESSBAR_RATE_UNIT_MAX characters (e.g. "it" or "B"). Passing NULL
+///             hides the rate again. The string is not copied.
+/// @param scale Whether to scale the rate with decimal (k, M, G...) or binary (Ki, Mi, Gi...) prefixes.
+/// @param window The time constant of the moving average, in seconds. Smaller windows react faster to changes.
+void progressbar_show_rate(progressbar *bar, const char *unit, progressbar_rate_scale scale, double window);
+
+/// Select how the progressbar estimates the remaining time. The default, PROGRESSBAR_ETA_AVERAGE, assumes a constant
+/// rate since the start, which misjudges jobs with a slow warm-up or a slowing tail; the other estimators weigh recent
+/// progress more heavily.
+///
+/// @param window The time constant in seconds over which the EWMA, regression and Kalman estimators forget older
+///               progress. Ignored by PROGRESSBAR_ETA_AVERAGE.
+void progressbar_set_eta_estimator(progressbar *bar, progressbar_eta_estimator kind, double window);
 
-/// Set the current status on the given progressbar.
-void progressbar_update(progressbar *bar, unsigned long value);
+/// Estimate the remaining time of the progressbar with a user-provided function, called whenever the bar is rendered.
+void progressbar_set_eta_callback(progressbar *bar, progressbar_eta_callback callback, void *state);
+
+/// Switch the progressbar between rendering in place and headless mode. In headless mode, meant for logs, the bar
+/// appends a compact newline-terminated status line (label, percentage, value, rate and ETA) every `interval` seconds
+/// and whenever the progress advanced by `percent_step` percent, so the log volume is bounded regardless of the
+/// number of updates. New bars start in headless mode if stderr isn't a terminal, logging every
+/// PROGRESSBAR_HEADLESS_INTERVAL seconds or PROGRESSBAR_HEADLESS_PERCENT_STEP percent. Switching modes replaces the
+/// interval of the redraw policy (see progressbar_set_redraw).
+void progressbar_set_headless(progressbar *bar, int enabled, double interval, double percent_step);
+
+/// Make the progressbar emit JSON-lines records instead of rendering a bar, for consumption by monitoring. A record
+/// is written to `fd` (see progressbar_set_sink_fd) every `interval` seconds and whenever the progress advanced by
+/// `percent_step` percent, e.g.
+///
+///     {"label":"Loading","value":420,"max":1000,"rate":35.5,"eta":16.338,"elapsed":11.832,"timestamp":1700000000.125}
+///
+/// `rate` is in steps per second, `eta` and `elapsed` in seconds, and `timestamp` is the wall-clock time in seconds
+/// since the epoch. Records are formatted in the bar's own buffer without allocating.
+void progressbar_set_json(progressbar *bar, int fd, double interval, double percent_step);
+
+/// Write the output of the progressbar to the file descriptor `fd` with write(2), bypassing stdio and its locks.
+/// This is the default, with `fd` being stderr. Switching sinks doesn't change the output format, so bars that
+/// started in headless mode (see progressbar_set_headless) keep writing status lines.
+void progressbar_set_sink_fd(progressbar *bar, int fd);
+
+/// Write the output of the progressbar to the stdio stream `file`, flushing it after each frame.
+void progressbar_set_sink_file(progressbar *bar, FILE *file);
+
+/// Keep the most recent `capacity` characters of output of the progressbar in the caller-provided `buffer`, e.g. to
+/// test or benchmark rendering without any I/O. Read it back via progressbar_sink_ring_read.
+void progressbar_set_sink_ring(progressbar *bar, char *buffer, size_t capacity);
+
+/// Copy the most recent output kept by the ring sink of the progressbar, oldest first, to `out`, which has room for
+/// `capacity` characters. The copy isn't NUL-terminated.
+///
+/// @return The number of characters copied.
+size_t progressbar_sink_ring_read(const progressbar *bar, char *out, size_t capacity);
+
+/// Pass the output of the progressbar to a user-provided function, one frame at a time.
+void progressbar_set_sink_callback(progressbar *bar, progressbar_sink_callback callback, void *state);
+
+/// Discard the output of the progressbar. The bar is then never rendered: its redraw window is closed, so that
+/// updates are reduced to the counter bump and compare, and not even frames are composed.
+void progressbar_set_sink_null(progressbar *bar);
+
+/// Render the progressbar incrementally: keep the frame that is on screen, and only write the cells that changed since
+/// (each run of them prefixed with an escape sequence moving the cursor to its column), which cuts the bytes written
+/// per frame by an order of magnitude on slow links. Frames of a different length, and frames with non-ASCII
+/// characters (whose columns can't be told from their bytes), are still written in full. Only enable this if nothing
+/// else writes to the bar's line, or call progressbar_invalidate after doing so.
+void progressbar_set_incremental(progressbar *bar, int enabled);
+
+/// Forget the frame on screen, so that the next rendering of an incremental progressbar writes the whole line, e.g.
+/// after other output went to the terminal.
+void progressbar_invalidate(progressbar *bar);
+
+/// Turn progress reporting off (or back on) at runtime for all progressbars created from now on, e.g. from a
+/// command line flag. Bars created while reporting is off get the null sink (see progressbar_set_sink_null), so
+/// their updates take a branch that is predicted never to be taken and nothing else. They stay silent for good:
+/// setting another sink, JSON output or an export later on has no effect. To remove progress reporting from a build
+/// altogether, define PROGRESSBAR_DISABLE instead.
+void progressbar_set_enabled(int enabled);
+
+/// Publish the progressbar's state to a shared memory object instead of rendering it, so that observers in other
+/// processes (such as the progress-top tool) can display the progress of many jobs without those jobs doing any
+/// terminal I/O. The state is published on the redraw schedule, every `interval` seconds and whenever the progress
+/// advanced by PROGRESSBAR_EXPORT_PERCENT_STEP percent, at the cost of a few stores to the mapping; increments
+/// themselves stay as cheap as ever. The object is unlinked when the bar is finished.
+///
+/// @param name The name of the shared memory object (see shm_open), or NULL to pick a unique name starting with
+///             PROGRESSBAR_EXPORT_PREFIX, under which observers look for progressbars.
+///
+/// Exporting a bar again moves it to the new object, and removes the previous one.
+///
+/// @return 0 on success, -1 if the object couldn't be created and mapped (in which case the bar is left unchanged).
+int progressbar_export(progressbar *bar, const char *name, double interval);
+
+/// Take a consistent snapshot of the progressbar exported to the shared memory object `name`, from any process.
+///
+/// @return 0 on success, -1 if the object doesn't exist, doesn't hold an exported progressbar, or stays in the middle
+///         of an update (e.g. because its process died while publishing).
+int progressbar_export_read(const char *name, progressbar_export_record *record);
+
+/// Install a SIGWINCH handler so that progressbars pick up a resized terminal on their next rendering. Without it,
+/// the cached terminal width is only refreshed every few seconds. The previous handler, if any, is still invoked.
+/// Calling it again while the handler is installed has no effect.
+///
+/// @return 0 on success, -1 if the handler couldn't be installed.
+int progressbar_watch_resize(void);
+
+/// Set the redraw policy of the progressbar. The bar is rendered again once at least `min_cells` cells of the bar
+/// changed, or once at least `interval` seconds (which may be fractional) passed since the last rendering, so that
+/// the ETA stays current. A `min_cells` of 0 or an `interval` of 0 disables the respective trigger; setting both to
+/// 0 renders on every update.
+void progressbar_set_redraw(progressbar *bar, unsigned int min_cells, double interval);
 
 /// Set the label of the progressbar. Note that no rendering is done. The label is simply set so that the next
 /// rendering will use the new label. To immediately see the new label, call progressbar_draw.
@@ -100,210 +720,2102 @@ void progressbar_update_label(progressbar *bar, const char *label);
 /// partway through.
 void progressbar_finish(progressbar *bar);
 
-/**
-* \file
-* \author Trevor Fountain
-* \author Johannes Buchner
-* \author Erik Garrison
-* \date 2010-2014
-* \copyright BSD 3-Clause
-*
-* progressbar -- a C class (by convention) for displaying progress
-* on the command line (to stderr).
-*/
+/// Create a pool of `capacity` progressbars. The storage of all bars is allocated up front, so that taking bars
+/// from the pool and returning them doesn't touch the heap.
+///
+/// @return The pool, or NULL if there isn't enough memory. Dispose of it via progressbar_pool_free.
+progressbar_pool *progressbar_pool_new(unsigned int capacity);
 
-//#include <termcap.h>  /* tgetent, tgetnum */
-#include <assert.h>
-#include <limits.h>
-#include <sys/ioctl.h>
-#include <termios.h>
-#include "progressbar.h"
+/// Take a progressbar from the pool and initialize it with the specified label and number of steps.
+///
+/// @return The progressbar, or NULL if all bars of the pool are in use.
+progressbar *progressbar_pool_acquire(progressbar_pool *pool, const char *label, unsigned long max);
 
-///  How wide we assume the screen is if termcap fails.
-enum { DEFAULT_SCREEN_WIDTH = 80 };
-/// The smallest that the bar can ever be (not including borders)
-enum { MINIMUM_BAR_WIDTH = 10 };
-/// The format in which the estimated remaining time will be reported
-static const char *const ETA_FORMAT = "ETA:%2dh%02dm%02ds";
-/// The maximum number of characters that the ETA_FORMAT can ever yield
-enum { ETA_FORMAT_LENGTH  = 13 };
-/// Amount of screen width taken up by whitespace (i.e. whitespace between label/bar/ETA components)
-enum { WHITESPACE_LENGTH = 2 };
-/// The amount of width taken up by the border of the bar component.
-enum { BAR_BORDER_WIDTH = 2 };
+/// Take a progressbar from the pool and initialize it without rendering it (see progressbar_init_deferred).
+///
+/// @return The progressbar, or NULL if all bars of the pool are in use.
+progressbar *progressbar_pool_acquire_deferred(progressbar_pool *pool, const char *label, unsigned long max);
 
-/// Models a duration of time broken into hour/minute/second components. The number of seconds should be less than the
-/// number of seconds in one minute, and the number of minutes should be less than the number of minutes in one hour.
-typedef struct {
-  int hours;
-  int minutes;
-  int seconds;
-} progressbar_time_components;
+/// Finalize a progressbar taken from the pool (see progressbar_destroy), and return it to the pool.
+void progressbar_pool_release(progressbar_pool *pool, progressbar *bar);
 
-static void progressbar_draw(const progressbar *bar);
+/// Free the pool. All of its progressbars must have been released.
+void progressbar_pool_free(progressbar_pool *pool);
 
-/**
-* Create a new progress bar with the specified label, max number of steps, and format string.
-* Note that `format` must be exactly three characters long, e.g. "<->" to render a progress
-* bar like "<---------->". Returns NULL if there isn't enough memory to allocate a progressbar
-*/
-progressbar *progressbar_new_with_format(const char *label, unsigned long max, const char *format)
-{
-  progressbar *new = malloc(sizeof(progressbar));
-  if(new == NULL) {
-    return NULL;
-  }
+/// Create a new, empty group of progressbars. Bars added to the group are displayed as a stacked block of lines
+/// instead of overwriting each other, and are rendered together.
+///
+/// @return The group, or NULL if there isn't enough memory. Dispose of it via progressbar_group_finish.
+progressbar_group *progressbar_group_new(void);
 
-  new->max = max;
-  new->value = 0;
-  new->start = time(NULL);
-  assert(3 == strlen(format) && "format must be 3 characters in length");
-  new->format.begin = format[0];
-  new->format.fill = format[1];
-  new->format.end = format[2];
+/// Add the progressbar to the bottom of the group, which takes ownership of it: from now on the bar is rendered by
+/// the group, and freed by progressbar_group_finish. Don't call progressbar_finish on a bar in a group.
+///
+/// @return 0 on success, -1 if there isn't enough memory (in which case the bar is left unchanged).
+int progressbar_group_add(progressbar_group *group, progressbar *bar);
 
-  progressbar_update_label(new, label);
-  progressbar_draw(new);
+/// Redraw the lines of all bars in the group whose state changed since the last refresh, in a single write. If
+/// another thread is already refreshing the group, the call returns right away and the change is picked up by a
+/// later refresh.
+void progressbar_group_refresh(progressbar_group *group);
 
-  return new;
-}
+/// Set the refresh tick of the group: when the redraw policy of a bar in the group asks for a redraw, the bar's line
+/// is only marked as changed, and the group refreshes all changed lines in one write at most once every `interval`
+/// seconds (PROGRESSBAR_GROUP_INTERVAL_MS milliseconds by default). Changes made since the last tick show with the
+/// next redraw of any bar after the tick, or when the group is refreshed or finished. An `interval` of 0 refreshes
+/// on every redraw.
+void progressbar_group_set_interval(progressbar_group *group, double interval);
 
-/**
-* Create a new progress bar with the specified label and max number of steps.
-*/
-progressbar *progressbar_new(const char *label, unsigned long max)
+/// Write the block of the group to the file descriptor `fd` with write(2). This is the default, with `fd` being
+/// stderr. Only the block of bars rendered in place goes to the group's sink; status lines and records of headless
+/// and JSON bars in the group go to each bar's own sink.
+void progressbar_group_set_sink_fd(progressbar_group *group, int fd);
+
+/// Write the block of the group to the stdio stream `file`, flushing it after each refresh.
+void progressbar_group_set_sink_file(progressbar_group *group, FILE *file);
+
+/// Pass the block of the group to a user-provided function, one refresh at a time.
+void progressbar_group_set_sink_callback(progressbar_group *group, progressbar_sink_callback callback, void *state);
+
+/// Finalize (and free!) the group and all of its bars, leaving their final state on screen. Children (see
+/// progressbar_new_child) are left to be freed by their parent.
+void progressbar_group_finish(progressbar_group *group);
+
+/*
+ * The update and increment functions are defined inline, so that the common case -- a counter bump and a compare
+ * against the redraw window -- is compiled into every call site.
+ */
+
+/// Decide whether the bar has to be rendered again according to its redraw policy.
+static inline int progressbar_redraw_due(progressbar *bar)
 {
-  return progressbar_new_with_format(label, max, "|=|");
+  if (bar->value < bar->redraw.value_lo || bar->value >= bar->redraw.value_hi) {
+    return 1;
+  }
+  if (bar->redraw.interval == 0 || --bar->redraw.clock_countdown > 0) {
+    return 0;
+  }
+  int due = progressbar_interval_elapsed(bar);
+  bar->redraw.clock_countdown = bar->redraw.clock_stride;
+  return due;
 }
 
-void progressbar_update_label(progressbar *bar, const char *label)
+/// Set the current status on the given progressbar, rendering it if anything visible changed.
+static inline void progressbar_update(progressbar *bar, unsigned long value)
 {
-  bar->label = label;
+  bar->value = value;
+  if (progressbar_redraw_due(bar)) {
+    progressbar_draw(bar);
+  }
 }
 
-/**
-* Delete an existing progress bar.
-*/
-void progressbar_free(progressbar *bar)
+/// Advance the given progressbar by `delta` steps at once, e.g. once per processed chunk. Rendering follows the
+/// same redraw policy as progressbar_update.
+static inline void progressbar_add(progressbar *bar, unsigned long delta)
 {
-  free(bar);
+  progressbar_update(bar, bar->value+delta);
 }
 
-/**
-* Increment an existing progressbar by `value` steps.
-*/
-void progressbar_update(progressbar *bar, unsigned long value)
+/// Increment the given progressbar. Don't increment past the initialized # of steps, though.
+static inline void progressbar_inc(progressbar *bar)
 {
-  bar->value = value;
-  progressbar_draw(bar);
+  progressbar_add(bar, 1);
 }
 
-/**
-* Increment an existing progressbar by a single step.
-*/
-void progressbar_inc(progressbar *bar)
+/// Advance the given progressbar by `delta` steps from any thread. The value is advanced atomically without taking
+/// a lock; whenever a redraw is due, at most one thread renders the bar while the others carry on without waiting.
+/// Don't mix with progressbar_inc/progressbar_update while other threads may advance the bar, and join all
+/// advancing threads before calling progressbar_finish.
+static inline void progressbar_add_concurrent(progressbar *bar, unsigned long delta)
 {
-  progressbar_update(bar, bar->value+1);
-}
+  unsigned long value = __atomic_add_fetch(&bar->value, delta, __ATOMIC_RELAXED);
 
-static void progressbar_write_char(FILE *file, const int ch, const size_t times) {
-  size_t i;
-  for (i = 0; i < times; ++i) {
-    fputc(ch, file);
+  // Only the upper bound of the redraw window is checked: a thread that was preempted between its increment and
+  // this check may observe a window that was already scheduled past its value, which doesn't warrant a redraw.
+  int due = value >= __atomic_load_n(&bar->redraw.value_hi, __ATOMIC_RELAXED);
+  // Sample the clock whenever the value crosses a multiple of the clock stride, i.e. when the value's remainder is
+  // smaller than the step just added. The stride is a power of two, so the remainder is a mask rather than a division.
+  unsigned long stride = __atomic_load_n(&bar->redraw.clock_stride, __ATOMIC_RELAXED);
+  if (!due && (bar->redraw.interval == 0 || (value & (stride - 1)) >= delta)) {
+    return;
   }
+
+  progressbar_try_draw(bar, due);
 }
 
-static int progressbar_max(int x, int y) {
-  return x > y ? x : y;
+/// Increment the given progressbar from any thread, see progressbar_add_concurrent.
+static inline void progressbar_inc_concurrent(progressbar *bar)
+{
+  progressbar_add_concurrent(bar, 1);
 }
 
-static unsigned int get_screen_width(void) {
-/*   char termbuf[2048]; */
-/*   if (tgetent(termbuf, getenv("TERM")) >= 0) { */
-    //return tgetnum("co") /* -2 */;
-/*   } else { */
-/*     return DEFAULT_SCREEN_WIDTH; */
-/*   } */
-    struct winsize ws;
+/// Advance the progressbar by `delta` steps through the calling thread's shard. The increment only touches the
+/// thread's own cache line; every so often the thread checks whether a redraw is due, rendering like
+/// progressbar_add_concurrent.
+static inline void progressbar_shard_add(progressbar_shard *shard, unsigned long delta)
+{
+  // Only the owning thread writes the shard, so a plain load and store suffice; no locked instruction is needed.
+  __atomic_store_n(&shard->value, shard->value + delta, __ATOMIC_RELAXED);
+  if (shard->countdown > delta) {
+    shard->countdown -= delta;
+    return;
+  }
+  progressbar_try_draw(shard->bar, 0);
+  shard->countdown = __atomic_load_n(&shard->bar->redraw.clock_stride, __ATOMIC_RELAXED);
+}
 
-    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == -1 || ws.ws_col == 0) {
-        return DEFAULT_SCREEN_WIDTH;
-    } else {
-        return ws.ws_col;
-    }
+/// Increment the progressbar through the calling thread's shard, see progressbar_shard_add.
+static inline void progressbar_shard_inc(progressbar_shard *shard)
+{
+  progressbar_shard_add(shard, 1);
 }
 
-static int progressbar_bar_width(int screen_width, int label_length) {
-  return progressbar_max(MINIMUM_BAR_WIDTH, screen_width - label_length - ETA_FORMAT_LENGTH - WHITESPACE_LENGTH);
+/// Add `delta` steps, counted locally by the calling thread of an OpenMP team (e.g. once per chunk of a parallel
+/// loop), to the progressbar. Any thread may add, but only the master thread renders, so that the other threads
+/// never wait on the terminal; see omp_for_bar.
+static inline void progressbar_omp_flush(progressbar *bar, unsigned long delta)
+{
+  unsigned long value = __atomic_add_fetch(&bar->value, delta, __ATOMIC_RELAXED);
+#if defined(_OPENMP)
+  if (omp_get_thread_num() != 0) {
+    return;
+  }
+#endif
+  progressbar_try_draw(bar, value >= __atomic_load_n(&bar->redraw.value_hi, __ATOMIC_RELAXED));
 }
 
-static int progressbar_label_width(int screen_width, int label_length, int bar_width) {
-  int eta_width = ETA_FORMAT_LENGTH;
+#else /* PROGRESSBAR_DISABLE */
 
-  // If the progressbar is too wide to fit on the screen, we must sacrifice the label.
-  if (label_length + 1 + bar_width + 1 + ETA_FORMAT_LENGTH > screen_width) {
-    return progressbar_max(0, screen_width - bar_width - eta_width - WHITESPACE_LENGTH);
-  } else {
-    return label_length;
-  }
+/*
+ * With PROGRESSBAR_DISABLE defined, every function of the API is an empty inline function, so that calls left in the
+ * source compile to nothing at all and the library doesn't even need to be linked. Functions returning objects hand
+ * out a dummy that is never touched, so that error checks for NULL still pass.
+ */
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#endif
+
+static inline progressbar *progressbar_disabled_bar(void)
+{
+  static progressbar bar;
+  return &bar;
 }
 
-static int progressbar_remaining_seconds(const progressbar* bar) {
-  double offset = difftime(time(NULL), bar->start);
-  if (bar->value > 0 && offset > 0) {
-    return (offset / (double) bar->value) * (bar->max - bar->value);
-  } else {
-    return 0;
-  }
+static inline progressbar *progressbar_new(const char *label, unsigned long max)
+{
+  return progressbar_disabled_bar();
 }
 
-static progressbar_time_components progressbar_calc_time_components(int seconds) {
-  int hours = seconds / 3600;
-  seconds -= hours * 3600;
-  int minutes = seconds / 60;
-  seconds -= minutes * 60;
+static inline progressbar *progressbar_new_with_format(const char *label, unsigned long max, const char *format)
+{
+  return progressbar_disabled_bar();
+}
 
-  progressbar_time_components components = {hours, minutes, seconds};
-  return components;
+static inline progressbar *progressbar_create(const char *label, unsigned long max, const char *format)
+{
+  return progressbar_disabled_bar();
 }
 
-static void progressbar_draw(const progressbar *bar)
+static inline progressbar *progressbar_new_child(progressbar *parent, const char *label, unsigned long max)
 {
-  int screen_width = get_screen_width();
-  int label_length = strlen(bar->label);
-  int bar_width = progressbar_bar_width(screen_width, label_length);
-  int label_width = progressbar_label_width(screen_width, label_length, bar_width);
+  return progressbar_disabled_bar();
+}
 
-  int progressbar_completed = (bar->value >= bar->max);
-  int bar_piece_count = bar_width - BAR_BORDER_WIDTH;
-  int bar_piece_current = (progressbar_completed)
-                          ? bar_piece_count
-                          : bar_piece_count * ((double) bar->value / bar->max);
+static inline void progressbar_init(progressbar *bar, const char *label, unsigned long max) {}
+static inline void progressbar_init_with_format(progressbar *bar, const char *label, unsigned long max,
+                                                const char *format) {}
+static inline void progressbar_init_deferred(progressbar *bar, const char *label, unsigned long max,
+                                             const char *format) {}
+static inline void progressbar_destroy(progressbar *bar) {}
+static inline void progressbar_free(progressbar *bar) {}
+static inline void progressbar_draw(progressbar *bar) {}
+static inline void progressbar_try_draw(progressbar *bar, int due) {}
+static inline int progressbar_interval_elapsed(progressbar *bar) { return 0; }
+static inline int progressbar_enable_shards(progressbar *bar, unsigned int count) { return 0; }
 
-  progressbar_time_components eta = (progressbar_completed)
-                                    ? progressbar_calc_time_components(difftime(time(NULL), bar->start))
-                                    : progressbar_calc_time_components(progressbar_remaining_seconds(bar));
+static inline progressbar_shard *progressbar_register_thread(progressbar *bar)
+{
+  static progressbar_shard shard;
+  return &shard;
+}
 
-  if (label_width == 0) {
-    // The label would usually have a trailing space, but in the case that we don't print
+static inline void progressbar_unregister_thread(progressbar_shard *shard) {}
+static inline int progressbar_start_renderer(progressbar *bar, unsigned int period_ms) { return 0; }
+static inline void progressbar_stop_renderer(progressbar *bar) {}
+static inline void progressbar_show_rate(progressbar *bar, const char *unit, progressbar_rate_scale scale,
+                                         double window) {}
+static inline void progressbar_set_eta_estimator(progressbar *bar, progressbar_eta_estimator kind, double window) {}
+static inline void progressbar_set_eta_callback(progressbar *bar, progressbar_eta_callback callback, void *state) {}
+static inline void progressbar_set_headless(progressbar *bar, int enabled, double interval, double percent_step) {}
+static inline void progressbar_set_json(progressbar *bar, int fd, double interval, double percent_step) {}
+static inline void progressbar_set_sink_fd(progressbar *bar, int fd) {}
+static inline void progressbar_set_sink_file(progressbar *bar, FILE *file) {}
+static inline void progressbar_set_sink_ring(progressbar *bar, char *buffer, size_t capacity) {}
+static inline size_t progressbar_sink_ring_read(const progressbar *bar, char *out, size_t capacity) { return 0; }
+static inline void progressbar_set_sink_callback(progressbar *bar, progressbar_sink_callback callback,
+                                                 void *state) {}
+static inline void progressbar_set_sink_null(progressbar *bar) {}
+static inline void progressbar_set_enabled(int enabled) {}
+static inline void progressbar_set_incremental(progressbar *bar, int enabled) {}
+static inline void progressbar_invalidate(progressbar *bar) {}
+static inline int progressbar_export(progressbar *bar, const char *name, double interval) { return 0; }
+static inline int progressbar_export_read(const char *name, progressbar_export_record *record) { return -1; }
+static inline int progressbar_watch_resize(void) { return 0; }
+static inline void progressbar_set_redraw(progressbar *bar, unsigned int min_cells, double interval) {}
+static inline void progressbar_update_label(progressbar *bar, const char *label) {}
+static inline void progressbar_finish(progressbar *bar) {}
+
+static inline progressbar_pool *progressbar_pool_new(unsigned int capacity)
+{
+  static progressbar_pool pool;
+  return &pool;
+}
+
+static inline progressbar *progressbar_pool_acquire(progressbar_pool *pool, const char *label, unsigned long max)
+{
+  return progressbar_disabled_bar();
+}
+
+static inline progressbar *progressbar_pool_acquire_deferred(progressbar_pool *pool, const char *label,
+                                                             unsigned long max)
+{
+  return progressbar_disabled_bar();
+}
+
+static inline void progressbar_pool_release(progressbar_pool *pool, progressbar *bar) {}
+static inline void progressbar_pool_free(progressbar_pool *pool) {}
+
+static inline progressbar_group *progressbar_group_new(void)
+{
+  static progressbar_group group;
+  return &group;
+}
+
+static inline int progressbar_group_add(progressbar_group *group, progressbar *bar) { return 0; }
+static inline void progressbar_group_refresh(progressbar_group *group) {}
+static inline void progressbar_group_set_interval(progressbar_group *group, double interval) {}
+static inline void progressbar_group_set_sink_fd(progressbar_group *group, int fd) {}
+static inline void progressbar_group_set_sink_file(progressbar_group *group, FILE *file) {}
+static inline void progressbar_group_set_sink_callback(progressbar_group *group, progressbar_sink_callback callback,
+                                                       void *state) {}
+static inline void progressbar_group_finish(progressbar_group *group) {}
+static inline void progressbar_update(progressbar *bar, unsigned long value) {}
+static inline void progressbar_add(progressbar *bar, unsigned long delta) {}
+static inline void progressbar_inc(progressbar *bar) {}
+static inline void progressbar_add_concurrent(progressbar *bar, unsigned long delta) {}
+static inline void progressbar_inc_concurrent(progressbar *bar) {}
+static inline void progressbar_shard_add(progressbar_shard *shard, unsigned long delta) {}
+static inline void progressbar_shard_inc(progressbar_shard *shard) {}
+static inline void progressbar_omp_flush(progressbar *bar, unsigned long delta) {}
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+
+/*
+ * The calls made once per iteration are shadowed by macros as well: even an empty inline call leaves a trace in the
+ * loop around it that can perturb register allocation, whereas a discarded expression leaves none. The arguments are
+ * still evaluated, as they would be by the functions.
+ */
+#define progressbar_update(bar, value) ((void) (bar), (void) (value))
+#define progressbar_add(bar, delta) ((void) (bar), (void) (delta))
+#define progressbar_inc(bar) ((void) (bar))
+#define progressbar_add_concurrent(bar, delta) ((void) (bar), (void) (delta))
+#define progressbar_inc_concurrent(bar) ((void) (bar))
+#define progressbar_shard_add(shard, delta) ((void) (shard), (void) (delta))
+#define progressbar_shard_inc(shard) ((void) (shard))
+#define progressbar_omp_flush(bar, delta) ((void) (bar), (void) (delta))
+
+#endif /* PROGRESSBAR_DISABLE */
+
+#if defined(PROGRESSBAR_IMPLEMENTATION) && !defined(PROGRESSBAR_DISABLE)
+
+//#include <termcap.h>  /* tgetent, tgetnum */
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <unistd.h>
+
+///  How wide we assume the screen is if termcap fails.
+enum { DEFAULT_SCREEN_WIDTH = 80 };
+/// The smallest that the bar can ever be (not including borders)
+enum { MINIMUM_BAR_WIDTH = 10 };
+/// The format in which the estimated remaining time will be reported (see progressbar_format_eta)
+static const char *const ETA_FORMAT = "ETA:%2dh%02dm%02ds";
+/// The number of characters that the ETA_FORMAT yields for an ETA below 100 hours
+enum { ETA_FORMAT_LENGTH  = 13 };
+/// The number of characters of the rate's number, e.g. "1023.9"
+enum { RATE_NUMBER_LENGTH = 6 };
+/// The number of characters that the rate yields besides the number and unit: a space, a prefix of up to two
+/// characters and "/s"
+enum { RATE_DECORATION_LENGTH = 5 };
+/// The default time constant of the EWMA, regression and Kalman ETA estimators, in seconds
+enum { DEFAULT_ETA_WINDOW = 10 };
+/// The largest ETA that is reported, in seconds; estimates beyond it (e.g. for a stalled bar) are clamped
+enum { MAXIMUM_ETA_SECONDS = 9999 * 3600 };
+/// The default time constant of the moving average of the rate, in seconds
+enum { DEFAULT_RATE_WINDOW = 1 };
+/// Amount of screen width taken up by whitespace (i.e. whitespace between label/bar/ETA components)
+enum { WHITESPACE_LENGTH = 2 };
+/// The amount of width taken up by the border of the bar component.
+enum { BAR_BORDER_WIDTH = 2 };
+/// The default number of bar cells that must change before the bar is redrawn
+enum { DEFAULT_REDRAW_MIN_CELLS = 1 };
+/// The default number of seconds after which the bar is redrawn even if no cell changed (to refresh the ETA)
+enum { DEFAULT_REDRAW_INTERVAL = 1 };
+/// The number of updates between the first samples of the clock when checking the redraw interval, until the update
+/// rate is known (a power of two, like every clock stride)
+enum { DEFAULT_REDRAW_CLOCK_STRIDE = 1 };
+/// The largest number of updates between two samples of the clock (a power of two), which bounds the delay of a
+/// time-triggered redraw after a burst of fast updates is followed by slow ones
+enum { MAXIMUM_REDRAW_CLOCK_STRIDE = 65536 };
+/// The number of times per redraw interval that the clock is sampled
+enum { REDRAW_CLOCK_SAMPLES = 8 };
+/// The longest run of unchanged cells that an incremental frame writes out rather than skipping with an escape
+/// sequence, which takes at least as many characters
+enum { INCREMENTAL_MERGE_GAP = 4 };
+/// The number of times a snapshot of an exported progressbar is attempted before giving up on a record whose writer
+/// seems to be gone in the middle of an update
+enum { EXPORT_READ_ATTEMPTS = 1000 };
+/// The number of seconds after which the cached screen width is queried again
+enum { SCREEN_WIDTH_REFRESH_INTERVAL = 5 };
+
+/// Cleared by progressbar_set_enabled to turn off the progressbars created from then on
+static int progressbar_enabled = 1;
+/// Whether stderr is a terminal, or -1 until the first bar is set up: checked once per process rather than per bar
+static int progressbar_stderr_terminal = -1;
+/// Bumped by the SIGWINCH handler; bars compare it against the generation their cached width was queried in.
+static volatile sig_atomic_t progressbar_resize_generation = 0;
+/// The SIGWINCH handler that was installed before progressbar_watch_resize
+static struct sigaction progressbar_previous_sigwinch;
+
+/// Models a duration of time broken into hour/minute/second components. The number of seconds should be less than the
+/// number of seconds in one minute, and the number of minutes should be less than the number of minutes in one hour.
+typedef struct {
+  int hours;
+  int minutes;
+  int seconds;
+} progressbar_time_components;
+
+static unsigned long progressbar_current_value(const progressbar *bar);
+static void progressbar_unexport(progressbar *bar);
+static void progressbar_report(progressbar *bar);
+
+/**
+* Initialize a progress bar in the given storage without rendering it.
+*/
+static void progressbar_setup(progressbar *bar, const char *label, unsigned long max, const char *format)
+{
+  bar->max = max;
+  bar->value = 0;
+  bar->start = progressbar_now();
+  assert(3 == strlen(format) && "format must be 3 characters in length");
+  bar->format.begin = format[0];
+  bar->format.fill = format[1];
+  bar->format.end = format[2];
+  bar->redraw.min_cells = DEFAULT_REDRAW_MIN_CELLS;
+  bar->redraw.interval = DEFAULT_REDRAW_INTERVAL;
+  bar->redraw.clock_stride = DEFAULT_REDRAW_CLOCK_STRIDE;
+  bar->redraw.clock_countdown = DEFAULT_REDRAW_CLOCK_STRIDE;
+  bar->redraw.value_lo = 0;
+  bar->redraw.value_hi = 0;
+  bar->redraw.last = bar->start;
+  bar->redraw.sampled = bar->start;
+  bar->redraw.rolled_up = 0;
+  bar->redraw.drawing = 0;
+  bar->shards = NULL;
+  bar->shard_count = 0;
+  bar->renderer.active = 0;
+  bar->screen.width = 0;
+  bar->screen.checked = 0;
+  bar->screen.generation = 0;
+  bar->rate.unit = NULL;
+  bar->rate.window = DEFAULT_RATE_WINDOW;
+  bar->rate.ewma = 0;
+  bar->rate.last_value = 0;
+  bar->rate.last_time = bar->start;
+  bar->line_length = 0;
+  bar->previous.enabled = 0;
+  bar->previous.length = 0;
+  bar->parent = NULL;
+  bar->children = NULL;
+  bar->child_count = 0;
+  bar->child_capacity = 0;
+  bar->child_index = 0;
+  bar->reported.value = 0;
+  bar->reported.max = 0;
+  bar->descendants.value = 0;
+  bar->descendants.max = 0;
+  bar->group = NULL;
+  bar->dirty = 0;
+  bar->group_line = -1;
+  bar->output.format = PROGRESSBAR_OUTPUT_BAR;
+  bar->output.disabled = 0;
+  bar->output.deferred = 0;
+  progressbar_set_sink_fd(bar, STDERR_FILENO);
+  bar->output.percent_step = PROGRESSBAR_HEADLESS_PERCENT_STEP;
+  bar->output.complete = 0;
+  bar->shared.record = NULL;
+  int terminal = __atomic_load_n(&progressbar_stderr_terminal, __ATOMIC_RELAXED);
+  if (terminal < 0) {
+    terminal = isatty(STDERR_FILENO);
+    __atomic_store_n(&progressbar_stderr_terminal, terminal, __ATOMIC_RELAXED);
+  }
+  if (!terminal) {
+    progressbar_set_headless(bar, 1, PROGRESSBAR_HEADLESS_INTERVAL, PROGRESSBAR_HEADLESS_PERCENT_STEP);
+  }
+  if (!__atomic_load_n(&progressbar_enabled, __ATOMIC_RELAXED)) {
+    progressbar_set_sink_null(bar);
+    bar->output.disabled = 1;
+  }
+  bar->eta.callback = NULL;
+  bar->eta.callback_state = NULL;
+  progressbar_set_eta_estimator(bar, PROGRESSBAR_ETA_AVERAGE, DEFAULT_ETA_WINDOW);
+
+  progressbar_update_label(bar, label);
+}
+
+/**
+* Allocate and initialize a progress bar without rendering it.
+*/
+progressbar *progressbar_create(const char *label, unsigned long max, const char *format)
+{
+  progressbar *bar = (progressbar *) malloc(sizeof(progressbar));
+  if(bar == NULL) {
+    return NULL;
+  }
+
+  progressbar_setup(bar, label, max, format);
+  return bar;
+}
+
+/**
+* Initialize a progress bar in caller-provided storage with the specified label and max number of steps.
+*/
+void progressbar_init(progressbar *bar, const char *label, unsigned long max)
+{
+  progressbar_init_with_format(bar, label, max, "|=|");
+}
+
+/**
+* Initialize a progress bar in caller-provided storage with the specified label, max number of steps, and format
+* string.
+*/
+void progressbar_init_with_format(progressbar *bar, const char *label, unsigned long max, const char *format)
+{
+  progressbar_setup(bar, label, max, format);
+  progressbar_draw(bar);
+}
+
+/**
+* Initialize a progress bar in caller-provided storage without rendering it, and hold off its first frame until it
+* has been running for its redraw interval.
+*/
+void progressbar_init_deferred(progressbar *bar, const char *label, unsigned long max, const char *format)
+{
+  progressbar_setup(bar, label, max, format);
+  if (bar->redraw.interval > 0 && !bar->output.disabled) {
+    // Leave only the clock to open the window.
+    bar->output.deferred = 1;
+    bar->redraw.value_lo = 0;
+    bar->redraw.value_hi = ULONG_MAX;
+  }
+}
+
+/**
+* Create a new progress bar with the specified label, max number of steps, and format string.
+* Note that `format` must be exactly three characters long, e.g. "<->" to render a progress
+* bar like "<---------->". Returns NULL if there isn't enough memory to allocate a progressbar
+*/
+progressbar *progressbar_new_with_format(const char *label, unsigned long max, const char *format)
+{
+  progressbar *bar = progressbar_create(label, max, format);
+  if (bar != NULL) {
+    progressbar_draw(bar);
+  }
+  return bar;
+}
+
+/**
+* Create a new progress bar that is part of `parent`. The child isn't rendered until it makes progress.
+*/
+progressbar *progressbar_new_child(progressbar *parent, const char *label, unsigned long max)
+{
+  if (parent->child_count == parent->child_capacity) {
+    unsigned int capacity = (parent->child_capacity == 0) ? 4 : 2 * parent->child_capacity;
+    progressbar **children = (progressbar **) realloc(parent->children, capacity * sizeof(progressbar *));
+    if (children == NULL) {
+      return NULL;
+    }
+    parent->children = children;
+    parent->child_capacity = capacity;
+  }
+
+  progressbar *child = progressbar_create(label, max, "|=|");
+  if (child == NULL) {
+    return NULL;
+  }
+  child->format = parent->format;
+  child->parent = parent;
+  child->child_index = parent->child_count;
+  parent->children[parent->child_count++] = child;
+  progressbar_report(child);
+  return child;
+}
+
+/**
+* Create a new progress bar with the specified label and max number of steps.
+*/
+progressbar *progressbar_new(const char *label, unsigned long max)
+{
+  return progressbar_new_with_format(label, max, "|=|");
+}
+
+/**
+* Force the next update of the bar to render, so that a new redraw policy or sink is applied from there on. While a
+* background renderer runs, the redraw window stays closed so that updates never render; the renderer renders on its
+* next period instead.
+*/
+static void progressbar_reopen_window(progressbar *bar)
+{
+  unsigned long value = progressbar_current_value(bar);
+  if (bar->renderer.active) {
+    __atomic_store_n(&bar->renderer.value_hi, value, __ATOMIC_RELAXED);
+    return;
+  }
+  __atomic_store_n(&bar->redraw.value_lo, value, __ATOMIC_RELAXED);
+  __atomic_store_n(&bar->redraw.value_hi, value, __ATOMIC_RELAXED);
+}
+
+void progressbar_set_redraw(progressbar *bar, unsigned int min_cells, double interval)
+{
+  bar->redraw.min_cells = min_cells;
+  if (bar->renderer.active) {
+    // The renderer applies the interval; see progressbar_reopen_window.
+    bar->renderer.interval = interval;
+  } else {
+    bar->redraw.interval = interval;
+  }
+  progressbar_reopen_window(bar);
+}
+
+void progressbar_show_rate(progressbar *bar, const char *unit, progressbar_rate_scale scale, double window)
+{
+  assert((unit == NULL || strlen(unit) <= PROGRESSBAR_RATE_UNIT_MAX) && "rate unit is too long");
+  bar->rate.unit = unit;
+  bar->rate.scale = scale;
+  bar->rate.window = window;
+  bar->rate.ewma = 0;
+  bar->rate.last_value = progressbar_current_value(bar);
+  bar->rate.last_time = progressbar_now();
+}
+
+void progressbar_set_eta_estimator(progressbar *bar, progressbar_eta_estimator kind, double window)
+{
+  bar->eta.kind = kind;
+  bar->eta.window = window;
+  bar->eta.last_elapsed = 0;
+  bar->eta.last_value = 0;
+  bar->eta.last_remaining = 0;
+  memset(&bar->eta.state, 0, sizeof(bar->eta.state));
+}
+
+void progressbar_set_eta_callback(progressbar *bar, progressbar_eta_callback callback, void *state)
+{
+  progressbar_set_eta_estimator(bar, PROGRESSBAR_ETA_CALLBACK, 0);
+  bar->eta.callback = callback;
+  bar->eta.callback_state = state;
+}
+
+void progressbar_set_headless(progressbar *bar, int enabled, double interval, double percent_step)
+{
+  bar->output.format = (enabled) ? PROGRESSBAR_OUTPUT_STATUS : PROGRESSBAR_OUTPUT_BAR;
+  bar->output.percent_step = percent_step;
+  progressbar_set_redraw(bar, bar->redraw.min_cells, interval);
+}
+
+void progressbar_set_json(progressbar *bar, int fd, double interval, double percent_step)
+{
+  if (bar->output.disabled) {
+    return;
+  }
+  bar->output.format = PROGRESSBAR_OUTPUT_JSON;
+  progressbar_set_sink_fd(bar, fd);
+  bar->output.percent_step = percent_step;
+  progressbar_set_redraw(bar, bar->redraw.min_cells, interval);
+}
+
+void progressbar_update_label(progressbar *bar, const char *label)
+{
+  bar->label = label;
+}
+
+/**
+* Release everything a progress bar holds on to, but not the bar itself.
+*/
+static void progressbar_release(progressbar *bar)
+{
+  unsigned int i;
+  for (i = 0; i < bar->child_count; ++i) {
+    progressbar_free(bar->children[i]);
+  }
+  free(bar->children);
+  progressbar_stop_renderer(bar);
+  free(bar->shards);
+  progressbar_unexport(bar);
+}
+
+/**
+* Delete an existing progress bar.
+*/
+void progressbar_free(progressbar *bar)
+{
+  progressbar_release(bar);
+  free(bar);
+}
+
+int progressbar_enable_shards(progressbar *bar, unsigned int count)
+{
+  void *shards;
+  if (posix_memalign(&shards, PROGRESSBAR_CACHE_LINE, count * sizeof(progressbar_shard)) != 0) {
+    return -1;
+  }
+  memset(shards, 0, count * sizeof(progressbar_shard));
+
+  free(bar->shards);
+  bar->shards = (progressbar_shard *) shards;
+  bar->shard_count = count;
+  return 0;
+}
+
+progressbar_shard *progressbar_register_thread(progressbar *bar)
+{
+  unsigned int i;
+  for (i = 0; i < bar->shard_count; ++i) {
+    progressbar_shard *shard = &bar->shards[i];
+    int expected = 0;
+    if (__atomic_compare_exchange_n(&shard->in_use, &expected, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+      shard->bar = bar;
+      shard->countdown = bar->redraw.clock_stride;
+      return shard;
+    }
+  }
+  return NULL;
+}
+
+void progressbar_unregister_thread(progressbar_shard *shard)
+{
+  // A renderer running concurrently may briefly count these increments twice; the next frame is exact again.
+  __atomic_add_fetch(&shard->bar->value, shard->value, __ATOMIC_RELAXED);
+  __atomic_store_n(&shard->value, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&shard->in_use, 0, __ATOMIC_RELEASE);
+}
+
+/**
+* Sum up the value of the progressbar and all of its shards.
+*/
+static unsigned long progressbar_current_value(const progressbar *bar)
+{
+  unsigned long value = __atomic_load_n(&bar->value, __ATOMIC_RELAXED);
+  unsigned int i;
+  for (i = 0; i < bar->shard_count; ++i) {
+    value += __atomic_load_n(&bar->shards[i].value, __ATOMIC_RELAXED);
+  }
+  return value;
+}
+
+/**
+* Sum up the value and max of the progressbar and all of its descendants, as last reported by them. A descendant's
+* value counts at most up to its max, so that overshooting one child doesn't make up for another one lagging behind.
+*/
+static void progressbar_rollup(const progressbar *bar, unsigned long *value, unsigned long *max)
+{
+  *value = progressbar_current_value(bar) + __atomic_load_n(&bar->descendants.value, __ATOMIC_RELAXED);
+  *max = bar->max + __atomic_load_n(&bar->descendants.max, __ATOMIC_RELAXED);
+}
+
+/**
+* Add the progress the bar made since it last reported to the running sums of all of its ancestors. Called whenever
+* the bar is rendered, so a parent sees its children's progress as of their last rendering.
+*/
+static void progressbar_report(progressbar *bar)
+{
+  progressbar *ancestor;
+  unsigned long value = progressbar_current_value(bar);
+  if (value > bar->max) {
+    value = bar->max;
+  }
+  // The differences may be negative (e.g. after progressbar_update went backwards); unsigned addition wraps around
+  // to the right sum.
+  unsigned long value_delta = value - bar->reported.value;
+  unsigned long max_delta = bar->max - bar->reported.max;
+  if (value_delta == 0 && max_delta == 0) {
+    return;
+  }
+  bar->reported.value = value;
+  bar->reported.max = bar->max;
+  for (ancestor = bar->parent; ancestor != NULL; ancestor = ancestor->parent) {
+    __atomic_add_fetch(&ancestor->descendants.value, value_delta, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&ancestor->descendants.max, max_delta, __ATOMIC_RELAXED);
+  }
+}
+
+/**
+* Remove a finished child from its parent's children. Its progress stays counted in its ancestors' running sums.
+*/
+static void progressbar_detach(progressbar *bar)
+{
+  progressbar *parent = bar->parent;
+  progressbar *last = parent->children[--parent->child_count];
+  parent->children[bar->child_index] = last;
+  last->child_index = bar->child_index;
+  bar->parent = NULL;
+}
+
+/**
+* Decide whether the progress of the bar rolled up over its children left the bar's redraw window, or its redraw
+* interval elapsed, so that a child's progress only redraws the parent as often as the parent's own policy allows.
+*/
+static int progressbar_rollup_due(const progressbar *bar)
+{
+  unsigned long value, max;
+  progressbar_rollup(bar, &value, &max);
+  if (value < bar->redraw.rolled_up) {
+    return 1;
+  }
+  value -= bar->redraw.rolled_up;
+  if (value < __atomic_load_n(&bar->redraw.value_lo, __ATOMIC_RELAXED)
+      || value >= __atomic_load_n(&bar->redraw.value_hi, __ATOMIC_RELAXED)) {
+    return 1;
+  }
+  return bar->redraw.interval != 0 && progressbar_now() - bar->redraw.last >= bar->redraw.interval;
+}
+
+/**
+* Render the bar if no other thread is currently doing so and a redraw is `due` (or turns out to be due).
+*/
+void progressbar_try_draw(progressbar *bar, int due)
+{
+  // Whoever wins the flag renders; everybody else moves on, so the increment never blocks.
+  if (__atomic_exchange_n(&bar->redraw.drawing, 1, __ATOMIC_ACQUIRE)) {
+    return;
+  }
+  if (due
+      || progressbar_current_value(bar) >= bar->redraw.value_hi
+      || (bar->redraw.interval != 0 && progressbar_interval_elapsed(bar))) {
+    progressbar_draw(bar);
+  }
+  __atomic_store_n(&bar->redraw.drawing, 0, __ATOMIC_RELEASE);
+}
+
+/**
+* Scale the clock stride of the bar so that `updates` updates taking `elapsed` seconds would span a fraction
+* 1/REDRAW_CLOCK_SAMPLES of the redraw interval, rounded down to a power of two. Only called by the thread rendering
+* the bar.
+*/
+static void progressbar_adapt_clock_stride(progressbar *bar, double updates, double elapsed)
+{
+  double target = bar->redraw.interval / REDRAW_CLOCK_SAMPLES;
+  double stride;
+
+  if (bar->redraw.interval == 0 || updates <= 0) {
+    return;
+  }
+  // A coarse clock may not advance at all between samples; double the stride until it does.
+  stride = (elapsed > 0) ? updates * target / elapsed : 2.0 * bar->redraw.clock_stride;
+  if (stride > MAXIMUM_REDRAW_CLOCK_STRIDE) {
+    stride = MAXIMUM_REDRAW_CLOCK_STRIDE;
+  } else if (stride < 1) {
+    stride = 1;
+  }
+  unsigned int rounded = (unsigned int) stride;
+  rounded = 1u << (sizeof(unsigned int) * CHAR_BIT - 1 - __builtin_clz(rounded));
+  // Read without synchronization by progressbar_add_concurrent and progressbar_shard_add.
+  __atomic_store_n(&bar->redraw.clock_stride, rounded, __ATOMIC_RELAXED);
+}
+
+int progressbar_interval_elapsed(progressbar *bar)
+{
+  double now = progressbar_now();
+
+  if (now - bar->redraw.last >= bar->redraw.interval) {
+    return 1;
+  }
+  // The clock is sampled once every stride, so that many updates happened since the previous sample.
+  progressbar_adapt_clock_stride(bar, bar->redraw.clock_stride, now - bar->redraw.sampled);
+  bar->redraw.sampled = now;
+  return 0;
+}
+
+/**
+* Decide whether the background renderer draws the bar in the current period. A bar is redrawn in place every
+* period, but status lines and records are appended to the output, so they follow the bar's redraw policy: they are
+* written once the progress leaves the redraw window or the interval elapsed, and not again once the bar is complete.
+*/
+static int progressbar_renderer_due(progressbar *bar)
+{
+  if (bar->output.format == PROGRESSBAR_OUTPUT_BAR
+      || progressbar_current_value(bar) >= __atomic_load_n(&bar->renderer.value_hi, __ATOMIC_RELAXED)) {
+    return 1;
+  }
+  return !bar->output.complete
+         && bar->renderer.interval != 0
+         && progressbar_now() - bar->redraw.last >= bar->renderer.interval;
+}
+
+/**
+* Body of the background renderer thread: draw the bar once per period, if due, until asked to stop.
+*/
+static void *progressbar_renderer_main(void *arg)
+{
+  progressbar *bar = (progressbar *) arg;
+
+  pthread_mutex_lock(&bar->renderer.lock);
+  while (!bar->renderer.stop) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += bar->renderer.period_ms / 1000;
+    deadline.tv_nsec += (long) (bar->renderer.period_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec += 1;
+      deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(&bar->renderer.wakeup, &bar->renderer.lock, &deadline);
+    if (bar->renderer.stop) {
+      break;
+    }
+
+    pthread_mutex_unlock(&bar->renderer.lock);
+    if (!__atomic_exchange_n(&bar->redraw.drawing, 1, __ATOMIC_ACQUIRE)) {
+      if (progressbar_renderer_due(bar)) {
+        progressbar_draw(bar);
+      }
+      __atomic_store_n(&bar->redraw.drawing, 0, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_lock(&bar->renderer.lock);
+  }
+  pthread_mutex_unlock(&bar->renderer.lock);
+
+  return NULL;
+}
+
+int progressbar_start_renderer(progressbar *bar, unsigned int period_ms)
+{
+  if (bar->renderer.active) {
+    pthread_mutex_lock(&bar->renderer.lock);
+    bar->renderer.period_ms = period_ms;
+    pthread_mutex_unlock(&bar->renderer.lock);
+    return 0;
+  }
+
+  if (pthread_mutex_init(&bar->renderer.lock, NULL) != 0) {
+    return -1;
+  }
+  // Time the waits on the monotonic clock, so that adjusting the wall clock doesn't stall or hurry the renderer.
+  pthread_condattr_t attr;
+  if (pthread_condattr_init(&attr) != 0) {
+    pthread_mutex_destroy(&bar->renderer.lock);
+    return -1;
+  }
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  int failed = pthread_cond_init(&bar->renderer.wakeup, &attr);
+  pthread_condattr_destroy(&attr);
+  if (failed) {
+    pthread_mutex_destroy(&bar->renderer.lock);
+    return -1;
+  }
+  bar->renderer.stop = 0;
+  bar->renderer.period_ms = period_ms;
+  bar->renderer.interval = bar->redraw.interval;
+  bar->renderer.value_hi = bar->redraw.value_hi;
+
+  // Close the redraw window for good, so that updates never render: see progressbar_schedule_redraw.
+  bar->renderer.active = 1;
+  bar->redraw.interval = 0;
+  __atomic_store_n(&bar->redraw.value_lo, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&bar->redraw.value_hi, ULONG_MAX, __ATOMIC_RELAXED);
+
+  if (pthread_create(&bar->renderer.thread, NULL, progressbar_renderer_main, bar) != 0) {
+    bar->renderer.stop = 1;
+    progressbar_stop_renderer(bar);
+    return -1;
+  }
+  return 0;
+}
+
+void progressbar_stop_renderer(progressbar *bar)
+{
+  if (!bar->renderer.active) {
+    return;
+  }
+
+  // The thread only exists if the flag is still clear; a failed pthread_create leaves it set.
+  if (!bar->renderer.stop) {
+    pthread_mutex_lock(&bar->renderer.lock);
+    bar->renderer.stop = 1;
+    pthread_cond_signal(&bar->renderer.wakeup);
+    pthread_mutex_unlock(&bar->renderer.lock);
+    pthread_join(bar->renderer.thread, NULL);
+  }
+  pthread_cond_destroy(&bar->renderer.wakeup);
+  pthread_mutex_destroy(&bar->renderer.lock);
+
+  bar->renderer.active = 0;
+  bar->redraw.interval = bar->renderer.interval;
+  // Force the next update to render in place again.
+  __atomic_store_n(&bar->redraw.value_lo, bar->value, __ATOMIC_RELAXED);
+  __atomic_store_n(&bar->redraw.value_hi, bar->value, __ATOMIC_RELAXED);
+}
+
+static int progressbar_max(int x, int y) {
+  return x > y ? x : y;
+}
+
+static unsigned int get_screen_width(void) {
+/*   char termbuf[2048]; */
+/*   if (tgetent(termbuf, getenv("TERM")) >= 0) { */
+    //return tgetnum("co") /* -2 */;
+/*   } else { */
+/*     return DEFAULT_SCREEN_WIDTH; */
+/*   } */
+    struct winsize ws;
+
+    // Query the stream the bar is drawn to, which may well be a terminal while stdout is redirected.
+    if (ioctl(STDERR_FILENO, TIOCGWINSZ, &ws) == -1 || ws.ws_col == 0) {
+        return DEFAULT_SCREEN_WIDTH;
+    } else {
+        return ws.ws_col;
+    }
+}
+
+static void progressbar_sigwinch_handler(int signum, siginfo_t *info, void *context) {
+  progressbar_resize_generation++;
+
+  if (progressbar_previous_sigwinch.sa_flags & SA_SIGINFO) {
+    if (progressbar_previous_sigwinch.sa_sigaction != NULL) {
+      progressbar_previous_sigwinch.sa_sigaction(signum, info, context);
+    }
+  } else if (progressbar_previous_sigwinch.sa_handler != SIG_DFL
+             && progressbar_previous_sigwinch.sa_handler != SIG_IGN) {
+    progressbar_previous_sigwinch.sa_handler(signum);
+  }
+}
+
+int progressbar_watch_resize(void)
+{
+  struct sigaction action;
+
+  // Installing the handler twice would make it its own previous handler, which it would call forever.
+  if (sigaction(SIGWINCH, NULL, &action) != 0) {
+    return -1;
+  }
+  if ((action.sa_flags & SA_SIGINFO) && action.sa_sigaction == progressbar_sigwinch_handler) {
+    return 0;
+  }
+
+  memset(&action, 0, sizeof(action));
+  action.sa_sigaction = progressbar_sigwinch_handler;
+  action.sa_flags = SA_SIGINFO | SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  return sigaction(SIGWINCH, &action, &progressbar_previous_sigwinch);
+}
+
+/**
+* Return the screen width cached in the bar, querying the terminal only after a resize or once the cached value
+* is older than SCREEN_WIDTH_REFRESH_INTERVAL seconds.
+*/
+static unsigned int progressbar_screen_width(progressbar *bar, double now) {
+  int generation = progressbar_resize_generation;
+  if (bar->screen.width == 0
+      || bar->screen.generation != generation
+      || now - bar->screen.checked >= SCREEN_WIDTH_REFRESH_INTERVAL) {
+    bar->screen.width = get_screen_width();
+    if (bar->screen.width > PROGRESSBAR_MAX_SCREEN_WIDTH) {
+      bar->screen.width = PROGRESSBAR_MAX_SCREEN_WIDTH;
+    }
+    bar->screen.checked = now;
+    bar->screen.generation = generation;
+  }
+  return bar->screen.width;
+}
+
+static int progressbar_bar_width(int screen_width, int label_length, int eta_width) {
+  return progressbar_max(MINIMUM_BAR_WIDTH, screen_width - label_length - eta_width - WHITESPACE_LENGTH);
+}
+
+static int progressbar_label_width(int screen_width, int label_length, int bar_width, int eta_width) {
+  // If the progressbar is too wide to fit on the screen, we must sacrifice the label.
+  if (label_length + 1 + bar_width + 1 + eta_width > screen_width) {
+    return progressbar_max(0, screen_width - bar_width - eta_width - WHITESPACE_LENGTH);
+  } else {
+    return label_length;
+  }
+}
+
+/**
+* Estimate the remaining time assuming the cumulative average rate holds.
+*/
+static double progressbar_eta_average(unsigned long value, unsigned long max, double elapsed) {
+  if (value > 0 && elapsed > 0) {
+    return (elapsed / (double) value) * (max - value);
+  } else {
+    return 0;
+  }
+}
+
+/**
+* Estimate the remaining time from an exponentially weighted moving average of the rate.
+*/
+static double progressbar_eta_ewma(progressbar *bar, unsigned long value, unsigned long max, double dt) {
+  double sample = ((double) value - (double) bar->eta.last_value) / dt;
+  if (bar->eta.last_elapsed == 0) {
+    bar->eta.state.ewma.rate = sample;
+  } else {
+    bar->eta.state.ewma.rate += dt / (dt + bar->eta.window) * (sample - bar->eta.state.ewma.rate);
+  }
+  return (bar->eta.state.ewma.rate > 0) ? (max - value) / bar->eta.state.ewma.rate : 0;
+}
+
+/**
+* Estimate the remaining time from the slope of a least-squares line through the recent samples. Older samples
+* are forgotten exponentially, which keeps the state down to a handful of running sums.
+*/
+static double progressbar_eta_regression(progressbar *bar, unsigned long value, unsigned long max, double dt) {
+  double decay = bar->eta.window / (dt + bar->eta.window);
+  double v = (double) value;
+  // Center the time axis on the current sample, so that the sums don't grow with the job's runtime.
+  double shift = dt;
+
+  bar->eta.state.regression.tt = decay * (bar->eta.state.regression.tt
+                                          - 2 * shift * bar->eta.state.regression.t
+                                          + shift * shift * bar->eta.state.regression.w);
+  bar->eta.state.regression.tv = decay * (bar->eta.state.regression.tv - shift * bar->eta.state.regression.v);
+  bar->eta.state.regression.t = decay * (bar->eta.state.regression.t - shift * bar->eta.state.regression.w);
+  bar->eta.state.regression.v = decay * bar->eta.state.regression.v + v;
+  bar->eta.state.regression.w = decay * bar->eta.state.regression.w + 1;
+
+  double w = bar->eta.state.regression.w;
+  double t = bar->eta.state.regression.t;
+  double denominator = w * bar->eta.state.regression.tt - t * t;
+  if (denominator <= 1e-12) {
+    return 0;
+  }
+  double slope = (w * bar->eta.state.regression.tv - t * bar->eta.state.regression.v) / denominator;
+  return (slope > 0) ? (max - value) / slope : 0;
+}
+
+/**
+* Estimate the remaining time from a constant-velocity Kalman filter over the value. The process noise lets the
+* rate drift by about its own magnitude over the window.
+*/
+static double progressbar_eta_kalman(progressbar *bar, unsigned long value, unsigned long max,
+                                     double elapsed, double dt) {
+  double z = (double) value;
+
+  if (bar->eta.last_elapsed == 0) {
+    bar->eta.state.kalman.value = z;
+    bar->eta.state.kalman.rate = z / elapsed;
+    bar->eta.state.kalman.p00 = 1;
+    bar->eta.state.kalman.p01 = 0;
+    bar->eta.state.kalman.p11 = bar->eta.state.kalman.rate * bar->eta.state.kalman.rate + 1;
+  } else {
+    double scale = (value > 0) ? value / elapsed : 1;
+    double q = scale * scale / bar->eta.window;
+    double dt2 = dt * dt;
+
+    // Predict
+    bar->eta.state.kalman.value += bar->eta.state.kalman.rate * dt;
+    double p00 = bar->eta.state.kalman.p00 + 2 * dt * bar->eta.state.kalman.p01 + dt2 * bar->eta.state.kalman.p11
+                 + q * dt2 * dt / 3;
+    double p01 = bar->eta.state.kalman.p01 + dt * bar->eta.state.kalman.p11 + q * dt2 / 2;
+    double p11 = bar->eta.state.kalman.p11 + q * dt;
+
+    // Update with the measured value (counting is exact up to the step granularity)
+    double r = 1;
+    double innovation = z - bar->eta.state.kalman.value;
+    double k0 = p00 / (p00 + r);
+    double k1 = p01 / (p00 + r);
+    bar->eta.state.kalman.value += k0 * innovation;
+    bar->eta.state.kalman.rate += k1 * innovation;
+    bar->eta.state.kalman.p00 = (1 - k0) * p00;
+    bar->eta.state.kalman.p01 = (1 - k0) * p01;
+    bar->eta.state.kalman.p11 = p11 - k1 * p01;
+  }
+
+  double remaining = max - bar->eta.state.kalman.value;
+  return (bar->eta.state.kalman.rate > 0 && remaining > 0) ? remaining / bar->eta.state.kalman.rate : 0;
+}
+
+/**
+* Feed the current value into the bar's estimator and return the estimated number of seconds remaining.
+*/
+static double progressbar_remaining_seconds(progressbar* bar, unsigned long value, unsigned long max,
+                                           double now) {
+  double elapsed = now - bar->start;
+  double dt = elapsed - bar->eta.last_elapsed;
+  double remaining;
+
+  if (value < bar->eta.last_value) {
+    // The bar was set back; start estimating afresh.
+    progressbar_set_eta_estimator(bar, bar->eta.kind, bar->eta.window);
+    dt = elapsed;
+  }
+
+  if (bar->eta.kind == PROGRESSBAR_ETA_CALLBACK && bar->eta.callback != NULL) {
+    remaining = bar->eta.callback(bar->eta.callback_state, value, max, elapsed);
+  } else if (bar->eta.kind == PROGRESSBAR_ETA_AVERAGE || bar->eta.kind == PROGRESSBAR_ETA_CALLBACK) {
+    // Without a callback (e.g. PROGRESSBAR_ETA_CALLBACK selected via progressbar_set_eta_estimator), fall back to
+    // the average rate.
+    remaining = progressbar_eta_average(value, max, elapsed);
+  } else if (dt < 1e-3) {
+    // Samples over very short periods are mostly noise; keep the previous estimate.
+    return bar->eta.last_remaining;
+  } else {
+    switch (bar->eta.kind) {
+    case PROGRESSBAR_ETA_EWMA:
+      remaining = progressbar_eta_ewma(bar, value, max, dt);
+      break;
+    case PROGRESSBAR_ETA_REGRESSION:
+      remaining = progressbar_eta_regression(bar, value, max, dt);
+      break;
+    default:
+      remaining = progressbar_eta_kalman(bar, value, max, elapsed, dt);
+      break;
+    }
+    bar->eta.last_elapsed = elapsed;
+    bar->eta.last_value = value;
+  }
+
+  if (!(remaining > 0)) {
+    remaining = 0;
+  } else if (remaining > MAXIMUM_ETA_SECONDS) {
+    remaining = MAXIMUM_ETA_SECONDS;
+  }
+  bar->eta.last_remaining = remaining;
+  return remaining;
+}
+
+/**
+* Compute the range of values that render the same bar as `bar_piece_current` filled cells (up to the
+* configured minimum cell change), so that updates within that range don't cause a redraw. `value` and `max` are
+* rolled up over the bar's children, of which `rolled_up` steps of `value` stem; the range is stored in terms of the
+* bar's own value, which is what the updates compare against.
+*/
+static void progressbar_schedule_redraw(progressbar *bar, unsigned long value, unsigned long max,
+                                        unsigned long rolled_up, double now,
+                                        int bar_piece_count, int bar_piece_current) {
+  unsigned long value_hi;
+  // While the background renderer runs, the bar's own interval is set aside and applied by the renderer.
+  double interval = (bar->renderer.active) ? bar->renderer.interval : bar->redraw.interval;
+  unsigned long previous = __atomic_load_n(&bar->redraw.value_lo, __ATOMIC_RELAXED);
+
+  // Estimate the update rate from the progress since the last rendering. Values are a lower bound of the number of
+  // updates, as an update may add more than one step.
+  if (value - rolled_up > previous) {
+    progressbar_adapt_clock_stride(bar, (double) (value - rolled_up - previous), now - bar->redraw.last);
+  }
+  bar->redraw.last = now;
+  bar->redraw.sampled = now;
+  bar->redraw.clock_countdown = bar->redraw.clock_stride;
+  bar->redraw.rolled_up = rolled_up;
+
+  if (bar_piece_count <= 0 || value >= max) {
+    // Render on every update.
+    value_hi = value;
+  } else if (bar->output.format != PROGRESSBAR_OUTPUT_BAR) {
+    // Log the next line once the progress advanced by the configured percentage.
+    double next = value + bar->output.percent_step / 100 * max;
+    if (bar->output.percent_step <= 0) {
+      value_hi = (interval == 0) ? value : max;
+    } else {
+      value_hi = (next >= (double) max) ? max : (unsigned long) next;
+      if (value_hi <= value) {
+        value_hi = value + 1;
+      }
+    }
+  } else if (bar->redraw.min_cells == 0 && interval == 0) {
+    // Render on every update.
+    value_hi = value;
+  } else if (bar->redraw.min_cells == 0) {
+    // Only the interval triggers a redraw, apart from completing the bar.
+    value_hi = max;
+  } else {
+    double next = (double) (bar_piece_current + bar->redraw.min_cells) * max / bar_piece_count;
+    if (next >= (double) max) {
+      value_hi = max;
+    } else {
+      value_hi = (unsigned long) next;
+      // Compensate for truncation so that value_hi is the first value rendering the next cell.
+      if ((double) value_hi < next) {
+        value_hi++;
+      }
+    }
+  }
+
+  if (bar->renderer.active) {
+    // The background renderer draws the bar; updates must never trigger a redraw. The renderer itself only needs to
+    // know when the progress leaves the window, which is never before the next update.
+    __atomic_store_n(&bar->renderer.value_hi, ((value_hi > value) ? value_hi : value + 1) - rolled_up,
+                     __ATOMIC_RELAXED);
+    return;
+  }
+
+  // The window is read without synchronization by progressbar_inc_concurrent.
+  __atomic_store_n(&bar->redraw.value_lo, value - rolled_up, __ATOMIC_RELAXED);
+  __atomic_store_n(&bar->redraw.value_hi, value_hi - rolled_up, __ATOMIC_RELAXED);
+}
+
+static progressbar_time_components progressbar_calc_time_components(int seconds) {
+  int hours = seconds / 3600;
+  seconds -= hours * 3600;
+  int minutes = seconds / 60;
+  seconds -= minutes * 60;
+
+  progressbar_time_components components = {hours, minutes, seconds};
+  return components;
+}
+
+/**
+* Write `number` in decimal to `out`, left-padded with `pad` to at least `width` characters. Returns the number of
+* characters written.
+*/
+static size_t progressbar_format_int(char *out, unsigned long number, size_t width, char pad) {
+  char digits[3 * sizeof(unsigned long)];
+  size_t count = 0;
+  size_t length = 0;
+  unsigned long n = number;
+
+  do {
+    digits[count++] = '0' + n % 10;
+    n /= 10;
+  } while (n > 0);
+
+  for (; width > count; --width) {
+    out[length++] = pad;
+  }
+  while (count > 0) {
+    out[length++] = digits[--count];
+  }
+  return length;
+}
+
+/**
+* Format the ETA like ETA_FORMAT into `out` without going through stdio. Returns the number of characters written.
+*/
+static size_t progressbar_format_eta(char *out, progressbar_time_components eta) {
+  size_t length = 0;
+  memcpy(out, "ETA:", 4);
+  length += 4;
+  // The components are never negative: the remaining time is clamped to zero, and the monotonic clock never goes
+  // backwards.
+  length += progressbar_format_int(out + length, eta.hours, 2, ' ');
+  out[length++] = 'h';
+  length += progressbar_format_int(out + length, eta.minutes, 2, '0');
+  out[length++] = 'm';
+  length += progressbar_format_int(out + length, eta.seconds, 2, '0');
+  out[length++] = 's';
+  return length;
+}
+
+/**
+* Feed the rate since the last sample into the moving average and return the smoothed rate.
+*/
+static double progressbar_sample_rate(progressbar *bar, unsigned long value, double now) {
+  double elapsed = now - bar->rate.last_time;
+  // Samples over very short periods are mostly noise; let them accumulate into the next one.
+  if (elapsed < 1e-3) {
+    return bar->rate.ewma;
+  }
+
+  double sample = ((double) value - (double) bar->rate.last_value) / elapsed;
+  if (sample < 0) {
+    sample = 0;
+  }
+  if (bar->rate.last_value == 0 && bar->rate.ewma == 0) {
+    bar->rate.ewma = sample;
+  } else {
+    // Weigh the sample by the time it covers, so that the average doesn't depend on how often the bar is rendered.
+    double weight = elapsed / (elapsed + bar->rate.window);
+    bar->rate.ewma += weight * (sample - bar->rate.ewma);
+  }
+  bar->rate.last_value = value;
+  bar->rate.last_time = now;
+  return bar->rate.ewma;
+}
+
+static double progressbar_average_rate(const progressbar *bar, unsigned long value, double now) {
+  double elapsed = now - bar->start;
+  return (elapsed > 0) ? value / elapsed : 0;
+}
+
+/**
+* Format `rate` with one decimal, an SI or IEC prefix and the unit into `out`, right-aligned to `width` characters.
+* Returns the number of characters written.
+*/
+static size_t progressbar_format_rate(char *out, double rate, const char *unit, progressbar_rate_scale scale,
+                                      size_t width) {
+  static const char *const si_prefixes[] = {"", "k", "M", "G", "T", "P", "E"};
+  static const char *const iec_prefixes[] = {"", "Ki", "Mi", "Gi", "Ti", "Pi", "Ei"};
+  const char *const *prefixes = (scale == PROGRESSBAR_RATE_IEC) ? iec_prefixes : si_prefixes;
+  const double base = (scale == PROGRESSBAR_RATE_IEC) ? 1024 : 1000;
+  const size_t last_prefix = sizeof(si_prefixes) / sizeof(si_prefixes[0]) - 1;
+
+  size_t prefix = 0;
+  // Scale before rounding, so that e.g. 999.96 is shown as "1.0 k" rather than "1000.0".
+  while (rate * 10 + 0.5 >= base * 10 && prefix < last_prefix) {
+    rate /= base;
+    ++prefix;
+  }
+  unsigned long tenths = (unsigned long) (rate * 10 + 0.5);
+
+  char field[RATE_NUMBER_LENGTH + RATE_DECORATION_LENGTH + PROGRESSBAR_RATE_UNIT_MAX];
+  size_t length = progressbar_format_int(field, tenths / 10, 0, ' ');
+  field[length++] = '.';
+  field[length++] = '0' + tenths % 10;
+  field[length++] = ' ';
+  memcpy(field + length, prefixes[prefix], strlen(prefixes[prefix]));
+  length += strlen(prefixes[prefix]);
+  memcpy(field + length, unit, strlen(unit));
+  length += strlen(unit);
+  memcpy(field + length, "/s", 2);
+  length += 2;
+
+  size_t padding = (width > length) ? width - length : 0;
+  memset(out, ' ', padding);
+  memcpy(out + padding, field, length);
+  return padding + length;
+}
+
+/**
+* Write the whole buffer to the file descriptor, resuming after partial writes and interruptions.
+*/
+static void progressbar_write_all(int fd, const char *buffer, size_t length) {
+  while (length > 0) {
+    ssize_t written = write(fd, buffer, length);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return;
+    }
+    buffer += written;
+    length -= written;
+  }
+}
+
+static void progressbar_sink_init_fd(progressbar_sink *sink, int fd)
+{
+  memset(sink, 0, sizeof(*sink));
+  sink->kind = PROGRESSBAR_SINK_FD;
+  sink->fd = fd;
+}
+
+static void progressbar_sink_init_file(progressbar_sink *sink, FILE *file)
+{
+  memset(sink, 0, sizeof(*sink));
+  sink->kind = PROGRESSBAR_SINK_FILE;
+  sink->file = file;
+}
+
+static void progressbar_sink_init_callback(progressbar_sink *sink, progressbar_sink_callback callback, void *state)
+{
+  memset(sink, 0, sizeof(*sink));
+  sink->kind = PROGRESSBAR_SINK_CALLBACK;
+  sink->callback = callback;
+  sink->callback_state = state;
+}
+
+void progressbar_set_sink_fd(progressbar *bar, int fd)
+{
+  if (bar->output.disabled) {
+    return;
+  }
+  progressbar_sink_init_fd(&bar->output.sink, fd);
+  progressbar_reopen_window(bar);
+}
+
+void progressbar_set_sink_file(progressbar *bar, FILE *file)
+{
+  if (bar->output.disabled) {
+    return;
+  }
+  progressbar_sink_init_file(&bar->output.sink, file);
+  progressbar_reopen_window(bar);
+}
+
+void progressbar_set_sink_ring(progressbar *bar, char *buffer, size_t capacity)
+{
+  if (bar->output.disabled) {
+    return;
+  }
+  memset(&bar->output.sink, 0, sizeof(bar->output.sink));
+  bar->output.sink.kind = PROGRESSBAR_SINK_RING;
+  bar->output.sink.ring = buffer;
+  bar->output.sink.ring_capacity = capacity;
+  progressbar_reopen_window(bar);
+}
+
+size_t progressbar_sink_ring_read(const progressbar *bar, char *out, size_t capacity)
+{
+  const progressbar_sink *sink = &bar->output.sink;
+  if (sink->kind != PROGRESSBAR_SINK_RING || sink->ring_capacity == 0) {
+    return 0;
+  }
+
+  size_t length = (sink->ring_written < sink->ring_capacity) ? sink->ring_written : sink->ring_capacity;
+  if (length > capacity) {
+    length = capacity;
+  }
+  // Copy the last `length` characters written, which may wrap around the end of the buffer.
+  size_t start = (sink->ring_written - length) % sink->ring_capacity;
+  size_t first = sink->ring_capacity - start;
+  if (first > length) {
+    first = length;
+  }
+  memcpy(out, sink->ring + start, first);
+  memcpy(out + first, sink->ring, length - first);
+  return length;
+}
+
+void progressbar_set_sink_callback(progressbar *bar, progressbar_sink_callback callback, void *state)
+{
+  if (bar->output.disabled) {
+    return;
+  }
+  progressbar_sink_init_callback(&bar->output.sink, callback, state);
+  progressbar_reopen_window(bar);
+}
+
+void progressbar_set_incremental(progressbar *bar, int enabled)
+{
+  bar->previous.enabled = enabled;
+  bar->previous.length = 0;
+}
+
+void progressbar_invalidate(progressbar *bar)
+{
+  bar->previous.length = 0;
+}
+
+void progressbar_set_enabled(int enabled)
+{
+  __atomic_store_n(&progressbar_enabled, enabled != 0, __ATOMIC_RELAXED);
+}
+
+void progressbar_set_sink_null(progressbar *bar)
+{
+  memset(&bar->output.sink, 0, sizeof(bar->output.sink));
+  bar->output.sink.kind = PROGRESSBAR_SINK_NULL;
+  __atomic_store_n(&bar->redraw.value_lo, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&bar->redraw.value_hi, ULONG_MAX, __ATOMIC_RELAXED);
+}
+
+/**
+* Write the whole buffer to the sink.
+*/
+static void progressbar_sink_write(progressbar_sink *sink, const char *buffer, size_t length)
+{
+  switch (sink->kind) {
+    case PROGRESSBAR_SINK_FD:
+      progressbar_write_all(sink->fd, buffer, length);
+      break;
+    case PROGRESSBAR_SINK_FILE:
+      fwrite(buffer, 1, length, sink->file);
+      fflush(sink->file);
+      break;
+    case PROGRESSBAR_SINK_RING:
+      if (sink->ring_capacity == 0) {
+        break;
+      }
+      // Only the tail of an oversized write survives anyway.
+      if (length > sink->ring_capacity) {
+        sink->ring_written += length - sink->ring_capacity;
+        buffer += length - sink->ring_capacity;
+        length = sink->ring_capacity;
+      }
+      while (length > 0) {
+        size_t offset = sink->ring_written % sink->ring_capacity;
+        size_t chunk = sink->ring_capacity - offset;
+        if (chunk > length) {
+          chunk = length;
+        }
+        memcpy(sink->ring + offset, buffer, chunk);
+        sink->ring_written += chunk;
+        buffer += chunk;
+        length -= chunk;
+      }
+      break;
+    case PROGRESSBAR_SINK_CALLBACK:
+      sink->callback(sink->callback_state, buffer, length);
+      break;
+    case PROGRESSBAR_SINK_NULL:
+      break;
+  }
+}
+
+/**
+* Compose a status line for headless mode in the bar's line buffer, e.g. "label: 42% (420/1000) ETA: 0h00m12s".
+*/
+static void progressbar_compose_status(progressbar *bar, unsigned long value, unsigned long max, double now,
+                                       progressbar_time_components eta)
+{
+  char *line = bar->line;
+  size_t length = 0;
+  size_t label_length = strlen(bar->label);
+  // Keep room for the numbers, the rate and the ETA after the label.
+  if (label_length > PROGRESSBAR_MAX_SCREEN_WIDTH / 2) {
+    label_length = PROGRESSBAR_MAX_SCREEN_WIDTH / 2;
+  }
+  int progressbar_completed = (value >= max);
+
+  if (label_length > 0) {
+    memcpy(line, bar->label, label_length);
+    length += label_length;
+    memcpy(line + length, ": ", 2);
+    length += 2;
+  }
+
+  unsigned long percent = (progressbar_completed) ? 100 : (unsigned long) (100 * ((double) value / max));
+  length += progressbar_format_int(line + length, percent, 0, ' ');
+  memcpy(line + length, "% (", 3);
+  length += 3;
+  length += progressbar_format_int(line + length, value, 0, ' ');
+  line[length++] = '/';
+  length += progressbar_format_int(line + length, max, 0, ' ');
+  memcpy(line + length, ") ", 2);
+  length += 2;
+
+  if (bar->rate.unit != NULL) {
+    double rate = (progressbar_completed)
+                  ? progressbar_average_rate(bar, value, now)
+                  : progressbar_sample_rate(bar, value, now);
+    length += progressbar_format_rate(line + length, rate, bar->rate.unit, bar->rate.scale, 0);
+    line[length++] = ' ';
+  }
+
+  length += progressbar_format_eta(line + length, eta);
+  assert(length < PROGRESSBAR_LINE_CAPACITY);
+  bar->line_length = length;
+}
+
+/**
+* Write `number`, which must not be negative, with three decimals to `out`. Returns the number of characters written.
+*/
+static size_t progressbar_format_fixed(char *out, double number) {
+  if (!(number > 0)) {
+    number = 0;
+  } else if (number > 1e15) {
+    number = 1e15;
+  }
+  double scaled = number * 1000 + 0.5;
+  unsigned long integer = (unsigned long) (scaled / 1000);
+  unsigned long thousandths = (unsigned long) (scaled - (double) integer * 1000);
+  if (thousandths > 999) {
+    thousandths = 999;
+  }
+
+  size_t length = progressbar_format_int(out, integer, 0, ' ');
+  out[length++] = '.';
+  length += progressbar_format_int(out + length, thousandths, 3, '0');
+  return length;
+}
+
+/**
+* Write `string` to `out` as a quoted JSON string, truncated so that at most `capacity` characters are written.
+* Returns the number of characters written.
+*/
+static size_t progressbar_format_json_string(char *out, const char *string, size_t capacity) {
+  static const char hex[] = "0123456789abcdef";
+  size_t length = 0;
+
+  out[length++] = '"';
+  for (; *string != '\0'; ++string) {
+    unsigned char ch = (unsigned char) *string;
+    // Leave room for the longest escape sequence and the closing quote.
+    if (length + 7 > capacity) {
+      break;
+    }
+    if (ch == '"' || ch == '\\') {
+      out[length++] = '\\';
+      out[length++] = ch;
+    } else if (ch < 0x20) {
+      memcpy(out + length, "\\u00", 4);
+      length += 4;
+      out[length++] = hex[ch >> 4];
+      out[length++] = hex[ch & 0xf];
+    } else {
+      out[length++] = ch;
+    }
+  }
+  out[length++] = '"';
+  return length;
+}
+
+/**
+* Compose a JSON record of the bar's state in its line buffer (see progressbar_set_json).
+*/
+static void progressbar_compose_json(progressbar *bar, unsigned long value, unsigned long max, double now,
+                                     double remaining)
+{
+  char *line = bar->line;
+  size_t length = 0;
+  double rate = (value >= max) ? progressbar_average_rate(bar, value, now) : progressbar_sample_rate(bar, value, now);
+  struct timespec timestamp;
+  clock_gettime(CLOCK_REALTIME, &timestamp);
+
+  memcpy(line + length, "{\"label\":", 9);
+  length += 9;
+  length += progressbar_format_json_string(line + length, bar->label, PROGRESSBAR_MAX_SCREEN_WIDTH / 2);
+  memcpy(line + length, ",\"value\":", 9);
+  length += 9;
+  length += progressbar_format_int(line + length, value, 0, ' ');
+  memcpy(line + length, ",\"max\":", 7);
+  length += 7;
+  length += progressbar_format_int(line + length, max, 0, ' ');
+  memcpy(line + length, ",\"rate\":", 8);
+  length += 8;
+  length += progressbar_format_fixed(line + length, rate);
+  memcpy(line + length, ",\"eta\":", 7);
+  length += 7;
+  length += progressbar_format_fixed(line + length, remaining);
+  memcpy(line + length, ",\"elapsed\":", 11);
+  length += 11;
+  length += progressbar_format_fixed(line + length, now - bar->start);
+  memcpy(line + length, ",\"timestamp\":", 13);
+  length += 13;
+  length += progressbar_format_fixed(line + length, timestamp.tv_sec + timestamp.tv_nsec / 1e9);
+  line[length++] = '}';
+  assert(length < PROGRESSBAR_LINE_CAPACITY);
+  bar->line_length = length;
+}
+
+int progressbar_export(progressbar *bar, const char *name, double interval)
+{
+  static unsigned int exported = 0;
+  char unique_name[PROGRESSBAR_EXPORT_NAME_CAPACITY];
+
+  if (bar->output.disabled) {
+    // There is nothing to publish, so don't leave an object behind for observers to find.
+    return 0;
+  }
+
+  int fd;
+  if (name == NULL) {
+    // A generated name must not take over an object that is still around, e.g. one left behind by a crashed
+    // process whose pid was reused; move on to the next name instead.
+    do {
+      size_t length = strlen(PROGRESSBAR_EXPORT_PREFIX);
+      memcpy(unique_name, PROGRESSBAR_EXPORT_PREFIX, length);
+      length += progressbar_format_int(unique_name + length, (unsigned long) getpid(), 0, ' ');
+      unique_name[length++] = '.';
+      length += progressbar_format_int(unique_name + length, __atomic_fetch_add(&exported, 1, __ATOMIC_RELAXED), 0,
+                                       ' ');
+      unique_name[length] = '\0';
+      fd = shm_open(unique_name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    } while (fd < 0 && errno == EEXIST);
+    name = unique_name;
+  } else if (strlen(name) >= PROGRESSBAR_EXPORT_NAME_CAPACITY) {
+    errno = ENAMETOOLONG;
+    return -1;
+  } else {
+    fd = shm_open(name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+  }
+  if (fd < 0) {
+    return -1;
+  }
+  void *mapping = MAP_FAILED;
+  if (ftruncate(fd, sizeof(progressbar_export_record)) == 0) {
+    mapping = mmap(NULL, sizeof(progressbar_export_record), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    shm_unlink(name);
+    return -1;
+  }
+
+  if (bar->shared.record != NULL) {
+    // The bar is exported already: retire its previous object, unless the new one replaces it under the same name.
+    if (strcmp(bar->shared.name, name) == 0) {
+      munmap(bar->shared.record, sizeof(progressbar_export_record));
+      bar->shared.record = NULL;
+    } else {
+      progressbar_unexport(bar);
+    }
+  }
+
+  // The object is zero-filled by ftruncate, so the sequence starts out even.
+  progressbar_export_record *record = (progressbar_export_record *) mapping;
+  record->magic = PROGRESSBAR_EXPORT_MAGIC;
+  record->version = PROGRESSBAR_EXPORT_VERSION;
+  record->pid = getpid();
+  strcpy(bar->shared.name, name);
+  bar->shared.record = record;
+
+  bar->output.format = PROGRESSBAR_OUTPUT_SHARED;
+  bar->output.percent_step = PROGRESSBAR_EXPORT_PERCENT_STEP;
+  progressbar_set_redraw(bar, bar->redraw.min_cells, interval);
+  return 0;
+}
+
+/**
+* Publish the state of an exported progress bar to its shared memory object.
+*/
+static void progressbar_publish(progressbar *bar, unsigned long value, unsigned long max, double now,
+                                double remaining, int finished)
+{
+  progressbar_export_record *record = bar->shared.record;
+  double rate = (value >= max) ? progressbar_average_rate(bar, value, now) : progressbar_sample_rate(bar, value, now);
+  double elapsed = now - bar->start;
+  struct timespec timestamp;
+  clock_gettime(CLOCK_REALTIME, &timestamp);
+  double wall_clock = timestamp.tv_sec + timestamp.tv_nsec / 1e9;
+
+  // Only the thread rendering the bar publishes, so the sequence has a single writer.
+  uint64_t sequence = record->sequence;
+  __atomic_store_n(&record->sequence, sequence + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  __atomic_store_n(&record->value, value, __ATOMIC_RELAXED);
+  __atomic_store_n(&record->max, max, __ATOMIC_RELAXED);
+  __atomic_store(&record->rate, &rate, __ATOMIC_RELAXED);
+  __atomic_store(&record->eta, &remaining, __ATOMIC_RELAXED);
+  __atomic_store(&record->elapsed, &elapsed, __ATOMIC_RELAXED);
+  __atomic_store(&record->timestamp, &wall_clock, __ATOMIC_RELAXED);
+  __atomic_store_n(&record->finished, finished, __ATOMIC_RELAXED);
+  strncpy(record->label, bar->label, PROGRESSBAR_EXPORT_LABEL_CAPACITY - 1);
+
+  __atomic_store_n(&record->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+/**
+* Mark an exported progress bar as finished, and remove its shared memory object.
+*/
+static void progressbar_unexport(progressbar *bar)
+{
+  progressbar_export_record *record = bar->shared.record;
+  if (record == NULL) {
+    return;
+  }
+
+  // Observers that still have the object mapped see the final state.
+  uint64_t sequence = record->sequence;
+  __atomic_store_n(&record->sequence, sequence + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  __atomic_store_n(&record->finished, 1, __ATOMIC_RELAXED);
+  __atomic_store_n(&record->sequence, sequence + 2, __ATOMIC_RELEASE);
+
+  munmap(record, sizeof(progressbar_export_record));
+  shm_unlink(bar->shared.name);
+  bar->shared.record = NULL;
+}
+
+int progressbar_export_read(const char *name, progressbar_export_record *record)
+{
+  int fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  struct stat status;
+  void *mapping = MAP_FAILED;
+  if (fstat(fd, &status) == 0 && status.st_size >= (off_t) sizeof(progressbar_export_record)) {
+    mapping = mmap(NULL, sizeof(progressbar_export_record), PROT_READ, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    return -1;
+  }
+
+  const progressbar_export_record *shared = (const progressbar_export_record *) mapping;
+  uint64_t before, after;
+  int attempts = 0;
+  for (;;) {
+    before = __atomic_load_n(&shared->sequence, __ATOMIC_ACQUIRE);
+    memcpy(record, (const void *) shared, sizeof(progressbar_export_record));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    after = __atomic_load_n(&shared->sequence, __ATOMIC_RELAXED);
+    if ((before & 1) == 0 && before == after) {
+      break;
+    }
+    if (++attempts == EXPORT_READ_ATTEMPTS) {
+      // A writer that died between making the sequence odd and even again leaves it odd for good.
+      munmap(mapping, sizeof(progressbar_export_record));
+      errno = EAGAIN;
+      return -1;
+    }
+    // Let a writer that was preempted in the middle of an update finish it.
+    sched_yield();
+  }
+  munmap(mapping, sizeof(progressbar_export_record));
+
+  record->label[PROGRESSBAR_EXPORT_LABEL_CAPACITY - 1] = '\0';
+  if (record->magic != PROGRESSBAR_EXPORT_MAGIC || record->version != PROGRESSBAR_EXPORT_VERSION) {
+    return -1;
+  }
+  return 0;
+}
+
+/**
+* Compose the current frame of the bar in its line buffer (without any leading or trailing cursor movement), and
+* schedule its next redraw.
+*/
+static void progressbar_compose(progressbar *bar)
+{
+  // Take a single snapshot of the value, as other threads may be incrementing it concurrently.
+  const unsigned long own_value = progressbar_current_value(bar);
+  unsigned long value, max;
+  if (bar->parent != NULL) {
+    progressbar_report(bar);
+  }
+  progressbar_rollup(bar, &value, &max);
+  bar->output.deferred = 0;
+  const double now = progressbar_now();
+  int screen_width = progressbar_screen_width(bar, now);
+  int label_length = strlen(bar->label);
+  // The rate, if shown, is drawn in front of the ETA and separated from it by a space.
+  int rate_width = (bar->rate.unit == NULL)
+                   ? 0
+                   : RATE_NUMBER_LENGTH + RATE_DECORATION_LENGTH + strlen(bar->rate.unit) + 1;
+  int bar_width = progressbar_bar_width(screen_width, label_length, rate_width + ETA_FORMAT_LENGTH);
+  int label_width = progressbar_label_width(screen_width, label_length, bar_width, rate_width + ETA_FORMAT_LENGTH);
+
+  int progressbar_completed = (value >= max);
+  bar->output.complete = progressbar_completed;
+  int bar_piece_count = bar_width - BAR_BORDER_WIDTH;
+  int bar_piece_current = (progressbar_completed)
+                          ? bar_piece_count
+                          : bar_piece_count * ((double) value / max);
+
+  double remaining = (progressbar_completed) ? 0 : progressbar_remaining_seconds(bar, value, max, now);
+  progressbar_time_components eta = (progressbar_completed)
+                                    ? progressbar_calc_time_components(now - bar->start)
+                                    : progressbar_calc_time_components(remaining);
+
+  if (bar->output.format == PROGRESSBAR_OUTPUT_STATUS) {
+    progressbar_compose_status(bar, value, max, now, eta);
+    progressbar_schedule_redraw(bar, value, max, value - own_value, now, 1, 0);
+    return;
+  } else if (bar->output.format == PROGRESSBAR_OUTPUT_JSON) {
+    progressbar_compose_json(bar, value, max, now, remaining);
+    progressbar_schedule_redraw(bar, value, max, value - own_value, now, 1, 0);
+    return;
+  } else if (bar->output.format == PROGRESSBAR_OUTPUT_SHARED) {
+    progressbar_publish(bar, value, max, now, remaining, 0);
+    bar->line_length = 0;
+    progressbar_schedule_redraw(bar, value, max, value - own_value, now, 1, 0);
+    return;
+  }
+
+  // Compose the whole frame in the bar's buffer, so that it is written with a single syscall and can't be torn
+  // apart by other output to stderr. Leave room for the carriage return appended by progressbar_draw.
+  char *line = bar->line;
+  size_t length = 0;
+
+  if (label_width == 0) {
+    // The label would usually have a trailing space, but in the case that we don't print
     // a label, the bar can use that space instead.
     bar_width += 1;
   } else {
     // Draw the label
-    fwrite(bar->label, 1, label_width, stderr);
-    fputc(' ', stderr);
+    memcpy(line, bar->label, label_width);
+    length += label_width;
+    line[length++] = ' ';
+  }
+
+  // Draw the progressbar
+  line[length++] = bar->format.begin;
+  memset(line + length, bar->format.fill, bar_piece_current);
+  length += bar_piece_current;
+  memset(line + length, ' ', bar_piece_count - bar_piece_current);
+  length += bar_piece_count - bar_piece_current;
+  line[length++] = bar->format.end;
+
+  // Draw the rate
+  line[length++] = ' ';
+  if (bar->rate.unit != NULL) {
+    double rate = (progressbar_completed)
+                  ? progressbar_average_rate(bar, value, now)
+                  : progressbar_sample_rate(bar, value, now);
+    length += progressbar_format_rate(line + length, rate, bar->rate.unit, bar->rate.scale, rate_width - 1);
+    line[length++] = ' ';
+  }
+
+  // Draw the ETA
+  length += progressbar_format_eta(line + length, eta);
+  assert(length < PROGRESSBAR_LINE_CAPACITY);
+  bar->line_length = length;
+
+  progressbar_schedule_redraw(bar, value, max, value - own_value, now, bar_piece_count, bar_piece_current);
+}
+
+/**
+* Write the changes that turn the frame on screen into the one composed in the line buffer of an incremental bar to
+* `out`: each run of changed cells, preceded by a cursor horizontal absolute escape. Returns 0 if the whole frame
+* should be written instead, because the frame on screen is unknown, has another length, or the changes would take
+* more characters than the frame itself. Columns are counted in characters, which only match the terminal's columns
+* for ASCII; if either frame has other characters (e.g. in a UTF-8 label), the new one is written in full.
+*/
+static int progressbar_compose_diff(const progressbar *bar, char *out, size_t *out_length)
+{
+  const char *line = bar->line;
+  const char *previous = bar->previous.frame;
+  size_t count = bar->line_length;
+  size_t length = 0;
+  size_t i = 0;
+
+  if (!bar->previous.enabled || bar->previous.length != count || count == 0) {
+    return 0;
+  }
+
+  while (i < count) {
+    if ((unsigned char) line[i] >= 0x80 || (unsigned char) previous[i] >= 0x80) {
+      return 0;
+    }
+    if (line[i] == previous[i]) {
+      ++i;
+      continue;
+    }
+    // Extend the run over any short gaps of unchanged cells, which are cheaper to write than to skip.
+    size_t end = i + 1;
+    size_t j;
+    for (j = end; j < count && (line[j] != previous[j] || j - end < INCREMENTAL_MERGE_GAP); ++j) {
+      if ((unsigned char) line[j] >= 0x80 || (unsigned char) previous[j] >= 0x80) {
+        return 0;
+      }
+      if (line[j] != previous[j]) {
+        end = j + 1;
+      }
+    }
+
+    char column[3 * sizeof(size_t)];
+    size_t column_length = progressbar_format_int(column, i + 1, 0, ' ');
+    if (length + 3 + column_length + (end - i) > count) {
+      return 0;
+    }
+    memcpy(out + length, "\33[", 2);
+    length += 2;
+    memcpy(out + length, column, column_length);
+    length += column_length;
+    out[length++] = 'G';
+    memcpy(out + length, line + i, end - i);
+    length += end - i;
+    i = end;
+  }
+
+  *out_length = length;
+  return 1;
+}
+
+/**
+* Remember the frame composed in the line buffer as the one on screen.
+*/
+static void progressbar_keep_frame(progressbar *bar)
+{
+  if (bar->previous.enabled) {
+    memcpy(bar->previous.frame, bar->line, bar->line_length);
+    bar->previous.length = bar->line_length;
   }
+}
 
-  // Draw the progressbar
-  fputc(bar->format.begin, stderr);
-  progressbar_write_char(stderr, bar->format.fill, bar_piece_current);
-  progressbar_write_char(stderr, ' ', bar_piece_count - bar_piece_current);
-  fputc(bar->format.end, stderr);
+void progressbar_draw(progressbar *bar)
+{
+  progressbar *ancestor;
 
-  // Draw the ETA
-  fputc(' ', stderr);
-  fprintf(stderr, ETA_FORMAT, eta.hours, eta.minutes, eta.seconds);
-  fputc('\r', stderr);
+  if (__builtin_expect(bar->output.sink.kind == PROGRESSBAR_SINK_NULL || bar->output.disabled, 0)) {
+    // Nothing will ever be shown: keep the redraw window closed (progressbar_set_redraw may have reopened it), and
+    // only look at the clock again after another interval.
+    __atomic_store_n(&bar->redraw.value_lo, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&bar->redraw.value_hi, ULONG_MAX, __ATOMIC_RELAXED);
+    bar->redraw.last = progressbar_now();
+    return;
+  }
+
+  if (bar->group != NULL) {
+    // The group composes and writes the line along with the other bars of the block, including the line of any
+    // ancestor in the same group, whose roll-up changes along with this bar, on its next refresh tick.
+    __atomic_store_n(&bar->dirty, 1, __ATOMIC_RELAXED);
+    for (ancestor = bar->parent; ancestor != NULL; ancestor = ancestor->parent) {
+      if (ancestor->group == bar->group) {
+        __atomic_store_n(&ancestor->dirty, 1, __ATOMIC_RELAXED);
+      }
+    }
+    if (progressbar_now() - bar->group->last >= bar->group->interval) {
+      progressbar_group_refresh(bar->group);
+    }
+    return;
+  }
+
+  if (bar->parent != NULL) {
+    // A child that isn't displayed by itself: keep its redraw window current, and show its progress through the
+    // parent instead, once the parent's redraw policy asks for it.
+    progressbar_compose(bar);
+    if (progressbar_rollup_due(bar->parent)) {
+      progressbar_try_draw(bar->parent, 1);
+    }
+    return;
+  }
+
+  progressbar_compose(bar);
+  if (bar->output.format == PROGRESSBAR_OUTPUT_SHARED) {
+    return;
+  }
+
+  char diff[PROGRESSBAR_LINE_CAPACITY];
+  size_t diff_length;
+  if (bar->output.format == PROGRESSBAR_OUTPUT_BAR && progressbar_compose_diff(bar, diff, &diff_length)) {
+    // The cursor rests at the start of the line, where the carriage return brings it back to.
+    if (diff_length > 0) {
+      diff[diff_length++] = '\r';
+      progressbar_sink_write(&bar->output.sink, diff, diff_length);
+    }
+    progressbar_keep_frame(bar);
+    return;
+  }
+
+  // Status lines and records are appended to the output rather than overwriting the previous frame.
+  bar->line[bar->line_length] = (bar->output.format == PROGRESSBAR_OUTPUT_BAR) ? '\r' : '\n';
+  progressbar_sink_write(&bar->output.sink, bar->line, bar->line_length + 1);
+  if (bar->output.format == PROGRESSBAR_OUTPUT_BAR) {
+    progressbar_keep_frame(bar);
+  }
+}
+
+/**
+* Finish a progressbar initialized by progressbar_init, indicating 100% completion.
+*/
+void progressbar_destroy(progressbar *bar)
+{
+  // Stop the background renderer first so that it can't draw over the final frame.
+  progressbar_stop_renderer(bar);
+
+  // A deferred bar that was never shown is left that way.
+  int shown = !bar->output.deferred;
+
+  // Make sure we fill the progressbar so things look complete. Status lines and records are appended rather than
+  // drawn over, so don't repeat one that already showed the bar complete.
+  if (shown && (bar->output.format == PROGRESSBAR_OUTPUT_BAR || !bar->output.complete)) {
+    progressbar_draw(bar);
+  }
+
+  if (bar->parent != NULL) {
+    // A child's final progress lives on in its ancestors' running sums, so the child itself can go right away
+    // rather than piling up until its parent is finished.
+    progressbar_report(bar);
+    progressbar_detach(bar);
+  } else if (shown && bar->output.format == PROGRESSBAR_OUTPUT_BAR) {
+    // Print a newline, so that future outputs look prettier (status lines and records already end in one)
+    progressbar_sink_write(&bar->output.sink, "\n", 1);
+  }
+
+  progressbar_release(bar);
 }
 
 /**
@@ -311,18 +2823,714 @@ static void progressbar_draw(const progressbar *bar)
 */
 void progressbar_finish(progressbar *bar)
 {
-  // Make sure we fill the progressbar so things look complete.
-  progressbar_draw(bar);
-
-  // Print a newline, so that future outputs to stderr look prettier
-  fprintf(stderr, "\n");
+  progressbar_destroy(bar);
 
   // We've finished with this progressbar, so go ahead and free it.
-  progressbar_free(bar);
+  free(bar);
+}
+
+progressbar_pool *progressbar_pool_new(unsigned int capacity)
+{
+  progressbar_pool *pool = (progressbar_pool *) malloc(sizeof(progressbar_pool));
+  if (pool == NULL) {
+    return NULL;
+  }
+
+  pool->bars = (progressbar *) malloc(capacity * sizeof(progressbar));
+  pool->free_list = (unsigned int *) malloc(capacity * sizeof(unsigned int));
+  if (pool->bars == NULL || pool->free_list == NULL) {
+    free(pool->bars);
+    free(pool->free_list);
+    free(pool);
+    return NULL;
+  }
+
+  unsigned int i;
+  for (i = 0; i < capacity; ++i) {
+    // Hand out the slots from the front of the array first.
+    pool->free_list[i] = capacity - 1 - i;
+  }
+  pool->free_count = capacity;
+  pool->capacity = capacity;
+  pool->lock = 0;
+  return pool;
+}
+
+/**
+* Take the storage of a progress bar from the pool, or return NULL if all bars of the pool are in use.
+*/
+static progressbar *progressbar_pool_take(progressbar_pool *pool)
+{
+  progressbar *bar = NULL;
+
+  while (__atomic_exchange_n(&pool->lock, 1, __ATOMIC_ACQUIRE)) {
+  }
+  if (pool->free_count > 0) {
+    bar = &pool->bars[pool->free_list[--pool->free_count]];
+  }
+  __atomic_store_n(&pool->lock, 0, __ATOMIC_RELEASE);
+  return bar;
+}
+
+progressbar *progressbar_pool_acquire(progressbar_pool *pool, const char *label, unsigned long max)
+{
+  progressbar *bar = progressbar_pool_take(pool);
+  if (bar != NULL) {
+    progressbar_init(bar, label, max);
+  }
+  return bar;
+}
+
+progressbar *progressbar_pool_acquire_deferred(progressbar_pool *pool, const char *label, unsigned long max)
+{
+  progressbar *bar = progressbar_pool_take(pool);
+  if (bar != NULL) {
+    progressbar_init_deferred(bar, label, max, "|=|");
+  }
+  return bar;
+}
+
+void progressbar_pool_release(progressbar_pool *pool, progressbar *bar)
+{
+  progressbar_destroy(bar);
+
+  while (__atomic_exchange_n(&pool->lock, 1, __ATOMIC_ACQUIRE)) {
+  }
+  pool->free_list[pool->free_count++] = (unsigned int) (bar - pool->bars);
+  __atomic_store_n(&pool->lock, 0, __ATOMIC_RELEASE);
+}
+
+void progressbar_pool_free(progressbar_pool *pool)
+{
+  free(pool->bars);
+  free(pool->free_list);
+  free(pool);
+}
+
+/// The most characters of cursor movement surrounding a line of a group: "\33[<n>A\r\33[K" before it and
+/// "\33[<n>B\r" after it, with up to ten digits for each n
+enum { GROUP_LINE_OVERHEAD = 2 * (2 + 10 + 2) + 3 };
+
+progressbar_group *progressbar_group_new(void)
+{
+  progressbar_group *group = (progressbar_group *) malloc(sizeof(progressbar_group));
+  if (group == NULL) {
+    return NULL;
+  }
+
+  group->bars = NULL;
+  group->count = 0;
+  group->capacity = 0;
+  group->lines = 0;
+  group->buffer = NULL;
+  progressbar_sink_init_fd(&group->sink, STDERR_FILENO);
+  group->interval = PROGRESSBAR_GROUP_INTERVAL_MS / 1000.0;
+  group->last = 0;
+  group->drawing = 0;
+  return group;
+}
+
+/**
+* Wait until no other thread refreshes the group, and claim it. Only used where waiting is rare and short (adding
+* bars and finishing the group); the refreshes themselves never wait.
+*/
+static void progressbar_group_lock(progressbar_group *group)
+{
+  while (__atomic_exchange_n(&group->drawing, 1, __ATOMIC_ACQUIRE)) {
+  }
+}
+
+static void progressbar_group_unlock(progressbar_group *group)
+{
+  __atomic_store_n(&group->drawing, 0, __ATOMIC_RELEASE);
+}
+
+/**
+* Compose the lines of all dirty bars, along with the cursor movement to reach them, and write them out at once.
+* The caller must have claimed the group.
+*/
+static void progressbar_group_draw(progressbar_group *group)
+{
+  char *buffer = group->buffer;
+  size_t length = 0;
+  unsigned int i;
+  group->last = progressbar_now();
+  for (i = 0; i < group->count; ++i) {
+    progressbar *bar = group->bars[i];
+    int in_place = (bar->output.format == PROGRESSBAR_OUTPUT_BAR);
+    if (bar->output.sink.kind == PROGRESSBAR_SINK_NULL) {
+      continue;
+    }
+    if (!__atomic_exchange_n(&bar->dirty, 0, __ATOMIC_RELAXED) && (bar->group_line >= 0 || !in_place)) {
+      continue;
+    }
+    progressbar_compose(bar);
+
+    if (bar->output.format == PROGRESSBAR_OUTPUT_SHARED) {
+      // Published by progressbar_compose; nothing to show.
+    } else if (!in_place) {
+      // There is no block to update in place; append the line to the bar's output instead, batched with the rest
+      // of the group if it goes to the same place.
+      bar->line[bar->line_length] = '\n';
+      if (bar->output.sink.kind == PROGRESSBAR_SINK_FD && group->sink.kind == PROGRESSBAR_SINK_FD
+          && bar->output.sink.fd == group->sink.fd) {
+        memcpy(buffer + length, bar->line, bar->line_length + 1);
+        length += bar->line_length + 1;
+      } else {
+        progressbar_sink_write(&bar->output.sink, bar->line, bar->line_length + 1);
+      }
+    } else if (bar->group_line >= 0) {
+      // Move up to the bar's line, overwrite it, and move back down below the block. The line is cleared before
+      // rather than after writing, as clearing after a full-width line would erase its last character.
+      int up = group->lines - bar->group_line;
+      size_t start = length;
+      size_t diff_length;
+      memcpy(buffer + length, "\33[", 2);
+      length += 2;
+      length += progressbar_format_int(buffer + length, up, 0, ' ');
+      buffer[length++] = 'A';
+      if (progressbar_compose_diff(bar, buffer + length, &diff_length)) {
+        if (diff_length == 0) {
+          // Nothing changed on the line, so there's no need to go there.
+          length = start;
+          continue;
+        }
+        length += diff_length;
+      } else {
+        memcpy(buffer + length, "\r\33[K", 4);
+        length += 4;
+        memcpy(buffer + length, bar->line, bar->line_length);
+        length += bar->line_length;
+      }
+      progressbar_keep_frame(bar);
+      memcpy(buffer + length, "\33[", 2);
+      length += 2;
+      length += progressbar_format_int(buffer + length, up, 0, ' ');
+      memcpy(buffer + length, "B\r", 2);
+      length += 2;
+    } else {
+      // The bar is new, so its line doesn't exist yet: extend the block at the bottom (clearing whatever the bar
+      // drew by itself before it joined the group).
+      memcpy(buffer + length, "\r\33[K", 4);
+      length += 4;
+      memcpy(buffer + length, bar->line, bar->line_length);
+      length += bar->line_length;
+      buffer[length++] = '\n';
+      bar->group_line = group->lines++;
+      progressbar_keep_frame(bar);
+    }
+  }
+
+  if (length > 0) {
+    progressbar_sink_write(&group->sink, buffer, length);
+  }
+}
+
+int progressbar_group_add(progressbar_group *group, progressbar *bar)
+{
+  progressbar_group_lock(group);
+
+  if (group->count == group->capacity) {
+    unsigned int capacity = (group->capacity == 0) ? 4 : 2 * group->capacity;
+    progressbar **bars = (progressbar **) realloc(group->bars, capacity * sizeof(progressbar *));
+    if (bars == NULL) {
+      progressbar_group_unlock(group);
+      return -1;
+    }
+    group->bars = bars;
+
+    char *buffer = (char *) realloc(group->buffer, capacity * (PROGRESSBAR_LINE_CAPACITY + GROUP_LINE_OVERHEAD));
+    if (buffer == NULL) {
+      progressbar_group_unlock(group);
+      return -1;
+    }
+    group->buffer = buffer;
+    group->capacity = capacity;
+  }
+
+  bar->group = group;
+  bar->dirty = 1;
+  bar->group_line = -1;
+  group->bars[group->count++] = bar;
+  progressbar_group_draw(group);
+
+  progressbar_group_unlock(group);
+  return 0;
+}
+
+void progressbar_group_set_interval(progressbar_group *group, double interval)
+{
+  group->interval = interval;
+}
+
+void progressbar_group_set_sink_fd(progressbar_group *group, int fd)
+{
+  progressbar_sink_init_fd(&group->sink, fd);
+}
+
+void progressbar_group_set_sink_file(progressbar_group *group, FILE *file)
+{
+  progressbar_sink_init_file(&group->sink, file);
+}
+
+void progressbar_group_set_sink_callback(progressbar_group *group, progressbar_sink_callback callback, void *state)
+{
+  progressbar_sink_init_callback(&group->sink, callback, state);
+}
+
+void progressbar_group_refresh(progressbar_group *group)
+{
+  if (__atomic_exchange_n(&group->drawing, 1, __ATOMIC_ACQUIRE)) {
+    return;
+  }
+  progressbar_group_draw(group);
+  progressbar_group_unlock(group);
+}
+
+void progressbar_group_finish(progressbar_group *group)
+{
+  unsigned int i;
+  for (i = 0; i < group->count; ++i) {
+    // Stop the background renderers first so that they can't draw over the final frame.
+    progressbar_stop_renderer(group->bars[i]);
+    group->bars[i]->dirty = 1;
+  }
+
+  // Make sure every bar shows its final state.
+  progressbar_group_lock(group);
+  progressbar_group_draw(group);
+  progressbar_group_unlock(group);
+
+  for (i = 0; i < group->count; ++i) {
+    // Children are freed by their parents; any that outlive the group go back to rendering through their parent.
+    group->bars[i]->group = NULL;
+    if (group->bars[i]->parent != NULL) {
+      group->bars[i] = NULL;
+    }
+  }
+  for (i = 0; i < group->count; ++i) {
+    if (group->bars[i] != NULL) {
+      progressbar_free(group->bars[i]);
+    }
+  }
+  free(group->bars);
+  free(group->buffer);
+  free(group);
 }
 
+#endif // PROGRESSBAR_IMPLEMENTATION
+
 #ifdef __cplusplus
 }
 #endif
 
+#ifdef __cplusplus
+
+#include <cstdlib>
+#include <iterator>
+#include <new>
+#include <type_traits>
+#include <utility>
+#if defined(__cpp_lib_execution)
+#include <algorithm>
+#include <execution>
+#include <vector>
+#endif
+
+/*
+ * C++ interface: progress::bar owns a progressbar and finishes it when it goes out of scope, so that early returns and
+ * exceptions neither leak the bar nor leave the terminal mid-line. How the bar counts, when it renders and where it
+ * writes to are template parameters, so that the chosen configuration inlines down to the same calls as the C API.
+ */
+namespace progress {
+
+/// Counter policy: advance the bar from a single thread (see progressbar_add)
+struct plain_counter {
+  static void add(progressbar *bar, unsigned long delta) { progressbar_add(bar, delta); }
+  static void update(progressbar *bar, unsigned long value) { progressbar_update(bar, value); }
+};
+
+/// Counter policy: advance the bar from any number of threads (see progressbar_add_concurrent). There is no way to
+/// set the value of such a bar, only to advance it.
+struct atomic_counter {
+  static void add(progressbar *bar, unsigned long delta) { progressbar_add_concurrent(bar, delta); }
+};
+
+/// Render policy: render once at least `MinCells` cells of the bar changed or `IntervalMs` milliseconds passed (see
+/// progressbar_set_redraw). The default matches the one of the C API.
+template <unsigned int MinCells = 1, unsigned int IntervalMs = 1000>
+struct throttle {
+  static void apply(progressbar *bar) { progressbar_set_redraw(bar, MinCells, IntervalMs / 1000.0); }
+};
+
+/// Render policy: render on every update
+struct every_update {
+  static void apply(progressbar *bar) { progressbar_set_redraw(bar, 0, 0); }
+};
+
+/// Render policy: render from a background thread every `PeriodMs` milliseconds, so that updates never render (see
+/// progressbar_start_renderer). If the thread can't be started, the bar renders from the updating threads instead.
+template <unsigned int PeriodMs = 100>
+struct background {
+  static void apply(progressbar *bar) { progressbar_start_renderer(bar, PeriodMs); }
+};
+
+/// Sink: write to stderr (the default of the C API)
+struct stderr_sink {
+  static void apply(progressbar *) {}
+};
+
+/// Sink: write to the file descriptor `Fd` (see progressbar_set_sink_fd)
+template <int Fd>
+struct fd_sink {
+  static void apply(progressbar *bar) { progressbar_set_sink_fd(bar, Fd); }
+};
+
+/// Sink: discard all output, so that the bar is never rendered (see progressbar_set_sink_null)
+struct null_sink {
+  static void apply(progressbar *bar) { progressbar_set_sink_null(bar); }
+};
+
+/// A progressbar that is finished (rendering its final state) when it is destroyed. Movable, but not copyable.
+template <class Counter = plain_counter, class RenderPolicy = throttle<>, class Sink = stderr_sink>
+class bar {
+public:
+  /// Create a progressbar with the specified label and number of steps. The label is not copied. Throws
+  /// std::bad_alloc if there isn't enough memory (or aborts, if exceptions are disabled).
+  bar(const char *label, unsigned long max) : bar_(progressbar_create(label, max, "|=|"))
+  {
+    if (bar_ == nullptr) {
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS)
+      throw std::bad_alloc();
+#else
+      std::abort();
+#endif
+    }
+    // Set the bar up before its first frame, so that nothing is written to stderr in place of the chosen sink.
+    Sink::apply(bar_);
+    RenderPolicy::apply(bar_);
+    progressbar_try_draw(bar_, 1);
+  }
+
+  ~bar() { finish(); }
+
+  bar(bar &&other) noexcept : bar_(other.bar_) { other.bar_ = nullptr; }
+
+  bar &operator=(bar &&other) noexcept
+  {
+    if (this != &other) {
+      finish();
+      bar_ = other.bar_;
+      other.bar_ = nullptr;
+    }
+    return *this;
+  }
+
+  bar(const bar &) = delete;
+  bar &operator=(const bar &) = delete;
+
+  /// Advance the bar by one step
+  void inc() { Counter::add(bar_, 1); }
+  bar &operator++() { inc(); return *this; }
+
+  /// Advance the bar by `delta` steps
+  void add(unsigned long delta) { Counter::add(bar_, delta); }
+  bar &operator+=(unsigned long delta) { add(delta); return *this; }
+
+  /// Set the current value of the bar (only with counter policies that support it, such as plain_counter)
+  void update(unsigned long value) { Counter::update(bar_, value); }
+
+  /// Set the label of the bar, shown from its next rendering on. The label is not copied.
+  void label(const char *label) { progressbar_update_label(bar_, label); }
+
+  /// Finish the bar now rather than on destruction; the object is empty afterwards.
+  void finish()
+  {
+    if (bar_ != nullptr) {
+      progressbar_finish(bar_);
+      bar_ = nullptr;
+    }
+  }
+
+  /// The underlying progressbar, for the parts of the C API not covered here, or NULL once the bar is finished
+  progressbar *get() const { return bar_; }
+
+private:
+  progressbar *bar_;
+};
+
+namespace detail {
+
+using std::begin;
+using std::end;
+
+/// The iterator type of a range, as found by a range-based for loop
+template <class Range>
+struct range_iterator {
+  typedef decltype(begin(std::declval<Range &>())) type;
+};
+
+template <class Range>
+typename range_iterator<Range>::type range_begin(Range &range) { return begin(range); }
+
+template <class Range>
+typename range_iterator<Range>::type range_end(Range &range) { return end(range); }
+
+/// The size of a range: from size() where available, by walking it otherwise. Only ranges of forward iterators can be
+/// walked, as walking a single-pass range (e.g. of std::istream_iterator) would consume it; the size of those has to
+/// be passed explicitly.
+template <class Range>
+auto range_size(Range &range, int) -> decltype((unsigned long) range.size())
+{
+  return (unsigned long) range.size();
+}
+
+template <class T, std::size_t N>
+unsigned long range_size(T (&)[N], int)
+{
+  return N;
+}
+
+template <class Range>
+unsigned long range_size(Range &range, long)
+{
+  typedef typename std::iterator_traits<typename range_iterator<Range>::type>::iterator_category category;
+  static_assert(std::is_base_of<std::forward_iterator_tag, category>::value,
+                "the size of a single-pass range can't be measured without consuming it: pass it to progress::track");
+  return (unsigned long) std::distance(range_begin(range), range_end(range));
+}
+
+} // namespace detail
+
+/// The number of updates of the progressbar that progress::track aims for over a whole range
+enum { TRACK_UPDATES = 1024 };
+
+template <class Range>
+class tracked_range;
+
+/// An iterator of a tracked range: advances the underlying iterator and counts the position locally, and only
+/// reports the position to the range's progressbar every so many steps.
+template <class Iterator, class Range>
+class tracked_iterator {
+public:
+  typedef std::input_iterator_tag iterator_category;
+  typedef typename std::iterator_traits<Iterator>::value_type value_type;
+  typedef typename std::iterator_traits<Iterator>::difference_type difference_type;
+  typedef typename std::iterator_traits<Iterator>::pointer pointer;
+  typedef typename std::iterator_traits<Iterator>::reference reference;
+
+  tracked_iterator() : it_(), owner_(NULL), position_(0), next_report_(0) {}
+
+  tracked_iterator(Iterator it, tracked_range<Range> *owner)
+      : it_(it), owner_(owner), position_(0), next_report_(owner->batch_) {}
+
+  /// Report the final position, e.g. after the loop ended or broke out early.
+  ~tracked_iterator()
+  {
+    if (owner_ != NULL) {
+      owner_->settle(position_);
+    }
+  }
+
+  tracked_iterator(const tracked_iterator &) = default;
+  tracked_iterator &operator=(const tracked_iterator &) = default;
+
+  reference operator*() const { return *it_; }
+  Iterator operator->() const { return it_; }
+
+  tracked_iterator &operator++()
+  {
+    ++it_;
+    if (++position_ == next_report_) {
+      owner_->report(position_);
+      next_report_ = position_ + owner_->batch_;
+    }
+    return *this;
+  }
+
+  tracked_iterator operator++(int)
+  {
+    tracked_iterator previous(*this);
+    ++*this;
+    return previous;
+  }
+
+  template <class Other>
+  bool operator==(const tracked_iterator<Other, Range> &other) const { return it_ == other.base(); }
+  template <class Other>
+  bool operator!=(const tracked_iterator<Other, Range> &other) const { return it_ != other.base(); }
+
+  /// The underlying iterator
+  const Iterator &base() const { return it_; }
+
+private:
+  Iterator it_;
+  tracked_range<Range> *owner_;
+  unsigned long position_;
+  unsigned long next_report_;
+};
+
+/// A range whose iteration is shown by a progressbar (see progress::track). The bar is finished along with the range.
+template <class Range>
+class tracked_range {
+public:
+  typedef typename detail::range_iterator<Range>::type iterator;
+
+  tracked_range(Range &&range, const char *label, unsigned long batch)
+      : tracked_range(std::forward<Range>(range), detail::range_size(range, 0), label, batch) {}
+
+  tracked_range(Range &&range, unsigned long size, const char *label, unsigned long batch)
+      : range_(std::forward<Range>(range)), bar_(label, size), batch_(batch), reported_(0)
+  {
+    if (batch_ == 0) {
+      batch_ = bar_.get()->max / TRACK_UPDATES + 1;
+    }
+  }
+
+  tracked_iterator<iterator, Range> begin()
+  {
+    return tracked_iterator<iterator, Range>(detail::range_begin(range_), this);
+  }
+
+  tracked_iterator<iterator, Range> end()
+  {
+    return tracked_iterator<iterator, Range>(detail::range_end(range_), this);
+  }
+
+  /// The progressbar showing the iteration
+  bar<> &progress_bar() { return bar_; }
+
+private:
+  friend class tracked_iterator<iterator, Range>;
+
+  void report(unsigned long position)
+  {
+    if (position > reported_) {
+      reported_ = position;
+      bar_.update(position);
+    }
+  }
+
+  void settle(unsigned long position) { report(position); }
+
+  Range range_;
+  bar<> bar_;
+  unsigned long batch_;
+  unsigned long reported_;
+};
+
+/// Iterate over `range` while showing the progress in a progressbar, e.g.
+///
+///     for (auto &x : progress::track(values, "Loading")) { ... }
+///
+/// The number of steps is the size of the range, so the range has to have a size() or forward iterators (see below
+/// for other ranges). Iterators count their position locally, so a step costs a compare and a branch, and the bar is
+/// only updated every `batch` steps (by default, a batch is a 1/TRACK_UPDATES of the range). An lvalue range is referenced, an rvalue range is moved into the returned object, which must outlive the
+/// loop (as it does in a range-based for loop).
+template <class Range>
+tracked_range<Range> track(Range &&range, const char *label, unsigned long batch = 0)
+{
+  return tracked_range<Range>(std::forward<Range>(range), label, batch);
+}
+
+/// Iterate over `range`, of `size` steps, while showing the progress in a progressbar, e.g.
+///
+///     for (auto &line : progress::track(lines(input), count, "Parsing")) { ... }
+///
+/// for ranges whose size can't be known up front without consuming them, such as ranges of input iterators.
+template <class Range>
+tracked_range<Range> track(Range &&range, unsigned long size, const char *label, unsigned long batch = 0)
+{
+  return tracked_range<Range>(std::forward<Range>(range), size, label, batch);
+}
+
+#if defined(__cpp_lib_execution)
+
+/*
+ * Progress-aware parallel algorithms, available when <execution> is included before this header. The range is split
+ * into chunks that the standard algorithm distributes over its workers; each chunk is processed sequentially and its
+ * completion is added to the bar with a single atomic addition, and the bar is rendered by a background thread, so
+ * that the workers never touch the terminal.
+ */
+
+/// The number of chunks the parallel algorithms split a range into by default: enough to balance the load over many
+/// workers, few enough for the per-chunk atomic addition not to matter
+enum { PARALLEL_CHUNKS = 4096 };
+
+/// The period in milliseconds at which the bars of the parallel algorithms are rendered
+enum { PARALLEL_RENDER_PERIOD_MS = 100 };
+
+namespace detail {
+
+/// Call `process(begin, end)` for consecutive chunks of [0, count) of `chunk` elements each (the size of a chunk is
+/// chosen by default if `chunk` is 0), under `policy`, and add the size of each chunk to a bar with the label.
+template <class ExecutionPolicy, class ChunkFunction>
+void for_each_chunk(ExecutionPolicy &&policy, std::size_t count, std::size_t chunk, const char *label,
+                    ChunkFunction process)
+{
+  if (chunk == 0) {
+    chunk = count / PARALLEL_CHUNKS + 1;
+  }
+  std::vector<std::size_t> starts;
+  starts.reserve(count / chunk + 1);
+  for (std::size_t start = 0; start < count; start += chunk) {
+    starts.push_back(start);
+  }
+
+  bar<atomic_counter, background<PARALLEL_RENDER_PERIOD_MS> > progress(label, count);
+  std::for_each(std::forward<ExecutionPolicy>(policy), starts.begin(), starts.end(), [&](std::size_t start) {
+    std::size_t end = (count - start < chunk) ? count : start + chunk;
+    process(start, end);
+    progress.add(end - start);
+  });
+}
+
+} // namespace detail
+
+/// Like std::for_each(policy, first, last, f), showing the progress in a progressbar with the label. The range is
+/// processed in chunks of `chunk` elements (by default, a 1/PARALLEL_CHUNKS of the range).
+template <class ExecutionPolicy, class RandomIt, class UnaryFunction>
+void for_each(ExecutionPolicy &&policy, RandomIt first, RandomIt last, UnaryFunction f, const char *label,
+              std::size_t chunk = 0)
+{
+  detail::for_each_chunk(std::forward<ExecutionPolicy>(policy), last - first, chunk, label,
+                         [&](std::size_t start, std::size_t end) {
+    for (RandomIt it = first + start; it != first + end; ++it) {
+      f(*it);
+    }
+  });
+}
+
+/// Like std::transform(policy, first, last, d_first, op), showing the progress in a progressbar with the label (see
+/// progress::for_each).
+template <class ExecutionPolicy, class RandomIt, class OutputIt, class UnaryOperation>
+OutputIt transform(ExecutionPolicy &&policy, RandomIt first, RandomIt last, OutputIt d_first, UnaryOperation op,
+                   const char *label, std::size_t chunk = 0)
+{
+  detail::for_each_chunk(std::forward<ExecutionPolicy>(policy), last - first, chunk, label,
+                         [&](std::size_t start, std::size_t end) {
+    std::transform(first + start, first + end, d_first + start, op);
+  });
+  return d_first + (last - first);
+}
+
+/// Like std::transform(policy, first1, last1, first2, d_first, op) for binary operations, showing the progress in a
+/// progressbar with the label (see progress::for_each).
+template <class ExecutionPolicy, class RandomIt1, class RandomIt2, class OutputIt, class BinaryOperation>
+OutputIt transform(ExecutionPolicy &&policy, RandomIt1 first1, RandomIt1 last1, RandomIt2 first2, OutputIt d_first,
+                   BinaryOperation op, const char *label, std::size_t chunk = 0)
+{
+  detail::for_each_chunk(std::forward<ExecutionPolicy>(policy), last1 - first1, chunk, label,
+                         [&](std::size_t start, std::size_t end) {
+    std::transform(first1 + start, first1 + end, first2 + start, d_first + start, op);
+  });
+  return d_first + (last1 - first1);
+}
+
+#endif // __cpp_lib_execution
+
+} // namespace progress
+
+#endif // __cplusplus
+
 #endif
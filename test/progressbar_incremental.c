@@ -0,0 +1,159 @@
+/**
+* \file
+* \copyright BSD 3-Clause
+*
+* Checks incremental rendering against a minimal terminal emulator: the output of a bar is fed, through a callback
+* sink, to an emulated line that understands carriage returns, cursor horizontal absolute and erase-in-line escapes
+* and UTF-8, and after every frame the line must show exactly the frame the bar composed. Exits with a non-zero
+* status on the first mismatch.
+*
+* Usage: progressbar_incremental
+*/
+
+#define PROGRESSBAR_IMPLEMENTATION
+#include "../progressbar.h"
+
+/// Number of frames rendered per scenario
+enum { TEST_FRAMES = 20000 };
+
+/// Number of columns of the emulated line
+enum { TERMINAL_COLUMNS = 512 };
+
+/// The emulated line: the bytes of the character shown in each column, and the cursor column
+typedef struct {
+  char cells[TERMINAL_COLUMNS][4];
+  size_t cell_lengths[TERMINAL_COLUMNS];
+  size_t column;
+  size_t bytes;
+  int failed;
+} terminal;
+
+static void terminal_write(void *state, const char *data, size_t length)
+{
+  terminal *term = (terminal *) state;
+  size_t i;
+
+  term->bytes += length;
+  for (i = 0; i < length; ++i) {
+    unsigned char c = (unsigned char) data[i];
+    if (c == '\r') {
+      term->column = 0;
+    } else if (c == '\n') {
+      // Only a single line is emulated.
+    } else if (c == '\33') {
+      size_t argument = 0;
+      if (i + 1 >= length || data[i + 1] != '[') {
+        term->failed = 1;
+        return;
+      }
+      for (i += 2; i < length && data[i] >= '0' && data[i] <= '9'; ++i) {
+        argument = argument * 10 + (data[i] - '0');
+      }
+      if (i < length && data[i] == 'G' && argument >= 1 && argument <= TERMINAL_COLUMNS) {
+        term->column = argument - 1;
+      } else if (i < length && data[i] == 'K') {
+        size_t column;
+        for (column = term->column; column < TERMINAL_COLUMNS; ++column) {
+          term->cell_lengths[column] = 0;
+        }
+      } else {
+        term->failed = 1;
+        return;
+      }
+    } else if ((c & 0xC0) == 0x80) {
+      // A UTF-8 continuation byte belongs to the character in the previous column.
+      if (term->column == 0 || term->cell_lengths[term->column - 1] >= 4) {
+        term->failed = 1;
+        return;
+      }
+      term->cells[term->column - 1][term->cell_lengths[term->column - 1]++] = (char) c;
+    } else {
+      if (term->column >= TERMINAL_COLUMNS) {
+        term->failed = 1;
+        return;
+      }
+      term->cells[term->column][0] = (char) c;
+      term->cell_lengths[term->column] = 1;
+      term->column++;
+    }
+  }
+}
+
+/**
+* Tell whether the emulated line shows exactly the frame composed by the bar.
+*/
+static int terminal_shows(const terminal *term, const progressbar *bar)
+{
+  size_t offset = 0;
+  size_t column;
+
+  for (column = 0; column < TERMINAL_COLUMNS && offset < bar->line_length; ++column) {
+    size_t length = term->cell_lengths[column];
+    if (length == 0 || offset + length > bar->line_length
+        || memcmp(term->cells[column], bar->line + offset, length) != 0) {
+      return 0;
+    }
+    offset += length;
+  }
+  return offset == bar->line_length && (column == TERMINAL_COLUMNS || term->cell_lengths[column] == 0);
+}
+
+/**
+* Render TEST_FRAMES frames of a bar with the given label, switching to `next_label` halfway if it isn't NULL, and
+* check the emulated line after each. Returns the number of bytes written, or 0 on a mismatch.
+*/
+static size_t test_scenario(const char *name, const char *label, const char *next_label, int incremental)
+{
+  static terminal term;
+  unsigned long i;
+
+  memset(&term, 0, sizeof(term));
+  progressbar *bar = progressbar_create(label, TEST_FRAMES, "|=|");
+  progressbar_set_headless(bar, 0, 1, 0);
+  progressbar_show_rate(bar, "B", PROGRESSBAR_RATE_IEC, 1.0);
+  progressbar_set_sink_callback(bar, terminal_write, &term);
+  progressbar_set_incremental(bar, incremental);
+
+  for (i = 0; i < TEST_FRAMES; ++i) {
+    if (next_label != NULL && i == TEST_FRAMES / 2) {
+      progressbar_update_label(bar, next_label);
+    }
+    bar->value = i;
+    progressbar_draw(bar);
+    if (term.failed || !terminal_shows(&term, bar)) {
+      printf("%-24s %s: line doesn't show frame %lu: %.*s\n", name, incremental ? "incremental" : "full", i,
+             (int) bar->line_length, bar->line);
+      progressbar_finish(bar);
+      return 0;
+    }
+  }
+  progressbar_finish(bar);
+  printf("%-24s %-12s %10zu bytes in %d frames\n", name, incremental ? "incremental" : "full", term.bytes,
+         TEST_FRAMES);
+  return term.bytes;
+}
+
+int main(void)
+{
+  static const struct {
+    const char *name;
+    const char *label;
+    const char *next_label;
+  } scenarios[] = {
+    {"ascii label", "Downloading", NULL},
+    {"utf-8 label", "Gr\xc3\xb6\xc3\x9f" "e \xe2\x9c\x93", NULL},
+    {"relabeled", "Downloading", "Decompressing"},
+    {"relabeled from utf-8", "Gr\xc3\xb6\xc3\x9f" "e \xe2\x9c\x93", "Downloading"},
+  };
+  size_t i;
+  int failed = 0;
+
+  for (i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); ++i) {
+    size_t full = test_scenario(scenarios[i].name, scenarios[i].label, scenarios[i].next_label, 0);
+    size_t incremental = test_scenario(scenarios[i].name, scenarios[i].label, scenarios[i].next_label, 1);
+    if (full == 0 || incremental == 0 || incremental > full) {
+      failed = 1;
+    }
+  }
+  return failed;
+}
@@ -0,0 +1,89 @@
+/**
+* \file
+* \copyright BSD 3-Clause
+*
+* progress-top -- show the progress of all progressbars exported by running processes (see progressbar_export).
+* Exported bars are found by scanning the shared memory objects for names starting with PROGRESSBAR_EXPORT_PREFIX;
+* reading them takes no cooperation from the processes, which never touch a terminal.
+*
+* Usage: progress-top [-1] [interval-seconds]
+*
+* With -1, the table is printed once instead of being refreshed every interval (1 second by default). Bars whose
+* process exited without finishing them are flagged as such.
+*/
+
+#define PROGRESSBAR_IMPLEMENTATION
+#include "../progressbar.h"
+
+#include <dirent.h>
+
+/// Where the shared memory objects live on Linux
+static const char *const SHM_DIRECTORY = "/dev/shm";
+
+/**
+* Print one line per exported progressbar. Returns the number of bars found.
+*/
+static unsigned int print_table(void)
+{
+  DIR *directory = opendir(SHM_DIRECTORY);
+  if (directory == NULL) {
+    perror(SHM_DIRECTORY);
+    return 0;
+  }
+
+  // The prefix without its leading slash, which the directory entries lack.
+  const char *prefix = PROGRESSBAR_EXPORT_PREFIX + 1;
+  unsigned int count = 0;
+  struct dirent *entry;
+  printf("%8s %-32s %6s %21s %12s %10s %10s\n", "PID", "LABEL", "DONE", "VALUE/MAX", "RATE/s", "ELAPSED", "ETA");
+  while ((entry = readdir(directory)) != NULL) {
+    if (strncmp(entry->d_name, prefix, strlen(prefix)) != 0) {
+      continue;
+    }
+    char name[NAME_MAX + 2];
+    snprintf(name, sizeof(name), "/%s", entry->d_name);
+    progressbar_export_record record;
+    if (progressbar_export_read(name, &record) != 0) {
+      continue;
+    }
+
+    // A bar that isn't finished but whose process is gone was abandoned, e.g. by a crash; its object stays behind
+    // until it is removed by hand.
+    int exited = !record.finished && kill((pid_t) record.pid, 0) != 0 && errno == ESRCH;
+
+    char counts[48];
+    snprintf(counts, sizeof(counts), "%llu/%llu", (unsigned long long) record.value, (unsigned long long) record.max);
+    double percent = (record.max == 0) ? 100 : 100.0 * record.value / record.max;
+    printf("%8lld %-32.32s %5.1f%% %21s %12.1f %9.1fs %9.1fs%s\n", (long long) record.pid, record.label, percent,
+           counts, record.rate, record.elapsed, record.eta, (record.finished) ? " done" : (exited) ? " exited" : "");
+    ++count;
+  }
+  closedir(directory);
+  return count;
+}
+
+int main(int argc, char *argv[])
+{
+  int once = 0;
+  double interval = 1;
+  int i;
+  for (i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "-1") == 0) {
+      once = 1;
+    } else {
+      interval = atof(argv[i]);
+    }
+  }
+
+  if (once) {
+    print_table();
+    return 0;
+  }
+  for (;;) {
+    // Clear the screen and home the cursor before each refresh.
+    printf("\33[H\33[2J");
+    print_table();
+    fflush(stdout);
+    usleep((useconds_t) (interval * 1e6));
+  }
+}